@@ -0,0 +1,309 @@
+#include "cantera-wm.h"
+
+#include <cstdlib>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include <X11/Xatom.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+
+#include "log.h"
+#include "settings.h"
+#include "xa.h"
+
+namespace cantera_wm {
+
+namespace {
+
+template <typename Reply>
+using ReplyPtr = std::unique_ptr<Reply, decltype(&free)>;
+
+// Waits for the reply to `cookie`.  Errors, e.g. for windows destroyed in
+// the meantime, yield null instead of reaching the Xlib error handler.
+template <typename Reply, typename Cookie>
+ReplyPtr<Reply> GetReply(Reply* (*get_reply)(xcb_connection_t*, Cookie,
+                                             xcb_generic_error_t**),
+                         xcb_connection_t* connection, Cookie cookie) {
+  xcb_generic_error_t* error = nullptr;
+  ReplyPtr<Reply> reply(get_reply(connection, cookie, &error), free);
+  free(error);
+
+  return reply;
+}
+
+// Returns element `index` of a 32-bit property, or `fallback` if it is
+// missing.
+uint32_t PropertyValue(const xcb_get_property_reply_t* reply, size_t index,
+                       uint32_t fallback = 0) {
+  if (!reply || reply->format != 32 || reply->value_len <= index)
+    return fallback;
+
+  return reinterpret_cast<const uint32_t*>(
+      xcb_get_property_value(reply))[index];
+}
+
+// The requests sent for one window.
+struct PendingWindow {
+  xcb_get_window_attributes_cookie_t attributes;
+  xcb_get_geometry_cookie_t geometry;
+  xcb_get_property_cookie_t wm_state;
+  xcb_get_property_cookie_t window_type;
+  xcb_get_property_cookie_t wm_hints;
+  xcb_get_property_cookie_t transient_for;
+  xcb_get_property_cookie_t name;
+  xcb_get_property_cookie_t pid;
+  xcb_get_property_cookie_t strut_partial;
+  xcb_get_property_cookie_t strut;
+  xcb_list_properties_cookie_t properties;
+};
+
+}  // namespace
+
+void Session::AdoptExistingWindows() {
+  xcb_connection_t* connection = XGetXCBConnection(x_display);
+
+  auto tree = GetReply(xcb_query_tree_reply, connection,
+                       xcb_query_tree(connection, x_root_window));
+
+  if (!tree) return;
+
+  const xcb_window_t* tree_begin = xcb_query_tree_children(tree.get());
+  const xcb_window_t* tree_end =
+      tree_begin + xcb_query_tree_children_length(tree.get());
+  std::unordered_set<xcb_window_t> existing(tree_begin, tree_end);
+
+  // Windows restored from a saved state may have been destroyed while no
+  // one was listening.
+  std::vector< ::Window> known, stale;
+
+  for (auto window : unpositioned_windows_) known.push_back(window->x_window);
+
+  for (auto& screen : screens_) {
+    for (auto window : screen.ancillary_windows)
+      known.push_back(window->x_window);
+
+    for (auto& entry : screen.workspaces) {
+      for (auto window : entry.second) known.push_back(window->x_window);
+    }
+  }
+
+  for (auto x_window : known) {
+    if (!existing.erase(x_window)) stale.push_back(x_window);
+  }
+
+  for (auto x_window : stale) remove_x_window(x_window);
+
+  // The rest are new to us, in stacking order.
+  std::vector<xcb_window_t> children;
+
+  for (auto i = tree_begin; i != tree_end; ++i) {
+    if (existing.count(*i) && !WindowIsInternal(*i)) children.push_back(*i);
+  }
+
+  size_t count = children.size();
+
+  // Every request is sent before the first reply is awaited, so adopting
+  // any number of windows costs one round trip.
+  std::vector<PendingWindow> pending(count);
+
+  // Property changes are selected first, as NewWindow() would, so that none
+  // made after the values below are read go unnoticed.
+  const uint32_t event_mask =
+      XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_FOCUS_CHANGE;
+
+  for (size_t i = 0; i < count; ++i) {
+    auto& p = pending[i];
+    xcb_window_t window = children[i];
+
+    xcb_change_window_attributes(connection, window, XCB_CW_EVENT_MASK,
+                                 &event_mask);
+
+    p.attributes = xcb_get_window_attributes(connection, window);
+    p.geometry = xcb_get_geometry(connection, window);
+    p.wm_state = xcb_get_property(connection, 0, window, xa::wm_state,
+                                  xa::wm_state, 0, 2);
+    p.window_type = xcb_get_property(connection, 0, window,
+                                     xa::net_wm_window_type, XA_ATOM, 0, 1);
+    p.wm_hints = xcb_get_property(connection, 0, window, XA_WM_HINTS,
+                                  XA_WM_HINTS, 0, 9);
+    p.transient_for = xcb_get_property(connection, 0, window,
+                                       XA_WM_TRANSIENT_FOR, XA_WINDOW, 0, 1);
+    p.name = xcb_get_property(connection, 0, window, XA_WM_NAME,
+                              XCB_GET_PROPERTY_TYPE_ANY, 0, 1024);
+    p.pid = xcb_get_property(connection, 0, window, xa::net_wm_pid,
+                             XA_CARDINAL, 0, 1);
+    p.strut_partial = xcb_get_property(connection, 0, window,
+                                       xa::net_wm_strut_partial, XA_CARDINAL,
+                                       0, 12);
+    p.strut = xcb_get_property(connection, 0, window, xa::net_wm_strut,
+                               XA_CARDINAL, 0, 4);
+    p.properties = xcb_list_properties(connection, window);
+  }
+
+  xcb_flush(connection);
+
+  size_t adopted = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    const auto& p = pending[i];
+    xcb_window_t x_window = children[i];
+
+    // All replies are collected, even for skipped windows, so none are left
+    // queued in the connection.
+    auto attributes =
+        GetReply(xcb_get_window_attributes_reply, connection, p.attributes);
+    auto geometry = GetReply(xcb_get_geometry_reply, connection, p.geometry);
+    auto wm_state = GetReply(xcb_get_property_reply, connection, p.wm_state);
+    auto window_type =
+        GetReply(xcb_get_property_reply, connection, p.window_type);
+    auto wm_hints = GetReply(xcb_get_property_reply, connection, p.wm_hints);
+    auto transient_for =
+        GetReply(xcb_get_property_reply, connection, p.transient_for);
+    auto name = GetReply(xcb_get_property_reply, connection, p.name);
+    auto pid = GetReply(xcb_get_property_reply, connection, p.pid);
+    auto strut_partial =
+        GetReply(xcb_get_property_reply, connection, p.strut_partial);
+    auto strut = GetReply(xcb_get_property_reply, connection, p.strut);
+    auto properties =
+        GetReply(xcb_list_properties_reply, connection, p.properties);
+
+    if (!attributes || !geometry ||
+        attributes->_class == XCB_WINDOW_CLASS_INPUT_ONLY)
+      continue;
+
+    Rectangle position;
+    position.x = geometry->x;
+    position.y = geometry->y;
+    position.width = geometry->width;
+    position.height = geometry->height;
+
+    auto w = NewWindow(x_window, position, attributes->override_redirect);
+
+    if (wm_hints && wm_hints->value_len > 1) {
+      XWMHints hints = {};
+      hints.flags = PropertyValue(wm_hints.get(), 0);
+      hints.input = PropertyValue(wm_hints.get(), 1);
+      w->SetWMHints(hints);
+    }
+
+    if (name) {
+      XTextProperty text_prop;
+      text_prop.value =
+          reinterpret_cast<unsigned char*>(xcb_get_property_value(name.get()));
+      text_prop.encoding = name->type;
+      text_prop.format = name->format;
+      text_prop.nitems = name->value_len;
+      w->SetName(text_prop);
+    }
+
+    w->SetType(PropertyValue(window_type.get(), 0, None),
+               PropertyValue(transient_for.get(), 0));
+    w->SetPID(PropertyValue(pid.get(), 0));
+
+    for (auto reply : {strut_partial.get(), strut.get()}) {
+      if (!reply || reply->format != 32 || !reply->value_len) continue;
+
+      auto values = reinterpret_cast<const uint32_t*>(
+          xcb_get_property_value(reply));
+      std::vector<unsigned long> strut_values(values,
+                                              values + reply->value_len);
+      w->SetStrut(strut_values.data(), strut_values.size());
+      break;
+    }
+
+    if (properties) {
+      const xcb_atom_t* atoms = xcb_list_properties_atoms(properties.get());
+      w->SetProperties(std::vector<Atom>(
+          atoms, atoms + xcb_list_properties_atoms_length(properties.get())));
+    }
+
+    Visual* visual = nullptr;
+    XVisualInfo visual_template;
+    int visual_count;
+
+    visual_template.visualid = attributes->visual;
+
+    if (auto info = XGetVisualInfo(x_display, VisualIDMask, &visual_template,
+                                   &visual_count)) {
+      visual = info->visual;
+      XFree(info);
+    }
+
+    bool viewable = attributes->map_state == XCB_MAP_STATE_VIEWABLE;
+
+    // Windows another window manager had iconified are mapped again, since
+    // we have no other way to show them.
+    auto state = PropertyValue(wm_state.get(), 0, WithdrawnState);
+    bool managed = viewable || state == NormalState || state == IconicState;
+
+    if (w->override_redirect || !managed || !visual) {
+      unpositioned_windows_.push_back(w);
+
+      if (viewable && visual) w->init_composite(visual);
+
+      continue;
+    }
+
+    w->SetMapped(true);
+
+    Screen* scr;
+    workspace* ws = nullptr;
+
+    if (w->Type() == Window::window_type_desktop) {
+      scr = ScreenAt(position);
+      move_window(w, scr, nullptr);
+      w->position = scr->geometry;
+    } else if (w->Type() == Window::window_type_dock) {
+      scr = ScreenAt(position);
+      move_window(w, scr, nullptr);
+
+      if (w->HasStrut()) StrutsChanged();
+    } else if (w->x_transient_for &&
+               find_x_window(w->x_transient_for, &ws, &scr) && ws) {
+      // Dialogs stay with the windows they belong to.
+      move_window(w, scr, ws);
+    } else {
+      scr = ScreenAt(position);
+
+      int workspace_index = scr->active_workspace;
+
+      if (w->Type() == Window::window_type_normal) {
+        int free_workspace = scr->workspaces.FindFree(
+            scr->active_workspace, settings.workspace_count);
+
+        if (free_workspace >= 0) workspace_index = free_workspace;
+      }
+
+      ws = &scr->workspaces.Get(workspace_index);
+      move_window(w, scr, ws);
+    }
+
+    scr->PlaceWindow(w);
+
+    if (!ws || ws == &scr->workspaces[scr->active_workspace])
+      w->show();
+    else
+      w->hide();
+
+    w->SetWMState(NormalState);
+
+    if (!viewable) XMapWindow(x_display, w->x_window);
+
+    w->init_composite(visual);
+
+    ++adopted;
+  }
+
+  if (adopted) {
+    auto scr = ActiveScreen();
+    scr->UpdateFocus(scr->active_workspace, CurrentTime);
+
+    SetDirty();
+  }
+
+  LOG(kInfo, "Adopted %zu of %zu untracked windows", adopted, count);
+}
+
+}  // namespace cantera_wm
@@ -5,117 +5,124 @@
 
 #include "arena.h"
 
-#define ARENA_BLOCK_SIZE (256 * 1024)
+#define ARENA_ROUND_UP(size) \
+  (((size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
 
-void arena_init(struct arena_info* arena) { memset(arena, 0, sizeof(*arena)); }
+struct arena_block {
+  struct arena_block* next;
+  size_t size;
+  size_t used;
+};
 
-void arena_free(struct arena_info* arena) {
-  struct arena_info* node;
-
-  node = arena->next;
+/* Data starts at this offset from the start of a block.  */
+#define ARENA_HEADER_SIZE ARENA_ROUND_UP(sizeof(struct arena_block))
 
-  while (node) {
-    struct arena_info* tmp;
+static struct arena_block* arena_new_block(struct arena_info* arena,
+                                           size_t size) {
+  void* data;
+  struct arena_block* block;
 
-    tmp = node;
-    node = node->next;
+  if (posix_memalign(&data, ARENA_ALIGNMENT, ARENA_HEADER_SIZE + size))
+    errx(EXIT_FAILURE, "failed to allocate memory for arena data");
 
-    free(tmp->data);
-    free(tmp);
-  }
+  block = data;
+  block->next = 0;
+  block->size = size;
+  block->used = 0;
 
-  free(arena->data);
+  ++arena->stats.block_count;
+  arena->stats.bytes_reserved += size;
 
-  memset(arena, 0, sizeof(*arena));
+  return block;
 }
 
-void* arena_alloc(struct arena_info* arena, size_t size) {
-  void* result;
-  struct arena_info* node;
+static void arena_free_blocks(struct arena_info* arena,
+                              struct arena_block* block) {
+  while (block) {
+    struct arena_block* tmp;
 
-  if (!size) return 0;
+    tmp = block;
+    block = block->next;
+
+    --arena->stats.block_count;
+    arena->stats.bytes_reserved -= tmp->size;
+
+    free(tmp);
+  }
+}
 
-  size = (size + 3) & ~3;
+void arena_init(struct arena_info* arena) {
+  arena_init_block_size(arena, ARENA_DEFAULT_BLOCK_SIZE);
+}
 
-  if (size > ARENA_BLOCK_SIZE) {
-    struct arena_info* new_arena;
+void arena_init_block_size(struct arena_info* arena, size_t block_size) {
+  memset(arena, 0, sizeof(*arena));
 
-    new_arena = malloc(sizeof(*new_arena));
+  arena->block_size = ARENA_ROUND_UP(block_size);
+}
 
-    if (!new_arena)
-      err(EXIT_SUCCESS, "failed to allocate memory for arena object");
+void arena_free(struct arena_info* arena) {
+  arena_free_blocks(arena, arena->large_blocks);
+  arena_free_blocks(arena, arena->blocks);
 
-    new_arena->data = malloc(size);
+  arena_init_block_size(arena, arena->block_size);
+}
 
-    if (!new_arena->data)
-      err(EXIT_SUCCESS, "failed to allocate memory for arena data");
+void arena_reset(struct arena_info* arena) {
+  struct arena_block* block;
 
-    new_arena->size = size;
-    new_arena->used = size;
-    new_arena->next = 0;
+  arena_free_blocks(arena, arena->large_blocks);
+  arena->large_blocks = 0;
 
-    if (!arena->last) {
-      arena->next = new_arena;
-      arena->last = new_arena;
-    } else {
-      arena->last->next = new_arena;
-      arena->last = new_arena;
-    }
+  for (block = arena->blocks; block; block = block->next) block->used = 0;
 
-    return new_arena->data;
-  }
+  arena->current = arena->blocks;
 
-  if (arena->last)
-    node = arena->last;
-  else {
-    if (!arena->data) {
-      arena->data = malloc(ARENA_BLOCK_SIZE);
+  arena->stats.alloc_count = 0;
+  arena->stats.bytes_allocated = 0;
+  ++arena->stats.reset_count;
+}
 
-      if (!arena->data)
-        err(EXIT_SUCCESS, "failed to allocate memory for arena data");
+void* arena_alloc(struct arena_info* arena, size_t size) {
+  struct arena_block* block;
 
-      arena->size = ARENA_BLOCK_SIZE;
-    }
+  if (!size) return 0;
 
-    node = arena;
-  }
+  size = ARENA_ROUND_UP(size);
 
-  if (size > node->size - node->used) {
-    struct arena_info* new_arena;
+  ++arena->stats.alloc_count;
+  arena->stats.bytes_allocated += size;
 
-    new_arena = malloc(sizeof(*new_arena));
+  if (size > arena->block_size) {
+    block = arena_new_block(arena, size);
+    block->used = size;
+    block->next = arena->large_blocks;
+    arena->large_blocks = block;
 
-    if (!new_arena)
-      err(EXIT_SUCCESS, "failed to allocate memory for arena object");
+    return (char*)block + ARENA_HEADER_SIZE;
+  }
 
-    new_arena->data = malloc(ARENA_BLOCK_SIZE);
+  if (!arena->current) {
+    arena->blocks = arena_new_block(arena, arena->block_size);
+    arena->current = arena->blocks;
+  }
 
-    if (!new_arena->data)
-      err(EXIT_SUCCESS, "failed to allocate memory for arena data");
+  block = arena->current;
 
-    new_arena->size = ARENA_BLOCK_SIZE;
-    new_arena->used = 0;
-    new_arena->next = 0;
+  if (size > block->size - block->used) {
+    if (!block->next) block->next = arena_new_block(arena, arena->block_size);
 
-    if (!arena->last) {
-      arena->next = new_arena;
-      arena->last = new_arena;
-    } else {
-      arena->last->next = new_arena;
-      arena->last = new_arena;
-    }
+    block = block->next;
+    arena->current = block;
 
-    node = new_arena;
+    assert(!block->used);
   }
 
-  assert(node->size == ARENA_BLOCK_SIZE);
-  assert(node->used < node->size);
-  assert(size <= node->size - node->used);
+  assert(size <= block->size - block->used);
 
-  result = (char*)node->data + node->used;
-  node->used += size;
+  block->used += size;
 
-  return result;
+  return (char*)block + ARENA_HEADER_SIZE + block->used - size;
 }
 
 void* arena_calloc(struct arena_info* arena, size_t size) {
@@ -7,19 +7,52 @@
 extern "C" {
 #endif
 
+/* Every pointer returned by the arena is aligned to this many bytes.  */
+#define ARENA_ALIGNMENT 16
+
+#define ARENA_DEFAULT_BLOCK_SIZE (256 * 1024)
+
+struct arena_block;
+
+struct arena_stats {
+  /* Number of blocks currently owned by the arena, and their total size.  */
+  size_t block_count;
+  size_t bytes_reserved;
+
+  /* Allocations and bytes handed out since the last reset.  */
+  size_t alloc_count;
+  size_t bytes_allocated;
+
+  /* Number of times the arena has been reset.  */
+  size_t reset_count;
+};
+
 struct arena_info {
-  void* data;
-  size_t size;
-  size_t used;
+  size_t block_size;
+
+  /* Blocks of `block_size` bytes.  Allocations are served from `current`;
+   * blocks after it are empty and are reused before new ones are
+   * allocated.  */
+  struct arena_block* blocks;
+  struct arena_block* current;
+
+  /* Allocations larger than `block_size` get a block of their own.  These
+   * are released by arena_reset.  */
+  struct arena_block* large_blocks;
 
-  struct arena_info* next;
-  struct arena_info* last;
+  struct arena_stats stats;
 };
 
 void arena_init(struct arena_info* arena);
 
+/* Like arena_init, but with a block size other than the default.  */
+void arena_init_block_size(struct arena_info* arena, size_t block_size);
+
 void arena_free(struct arena_info* arena);
 
+/* Releases all allocations at once, keeping regular blocks for reuse.  */
+void arena_reset(struct arena_info* arena);
+
 void* arena_alloc(struct arena_info* arena, size_t size);
 
 void* arena_calloc(struct arena_info* arena, size_t size);
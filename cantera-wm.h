@@ -3,20 +3,30 @@
 
 #include <X11/Xlib.h>
 #include <X11/Xproto.h>
+#include <X11/Xutil.h>
 
 #include <X11/extensions/Xdamage.h>
 #include <X11/extensions/Xrender.h>
 
 #undef ScreenCount
 
+#include <sys/types.h>
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace cantera_wm {
 
-extern const size_t kWorkspaceCount;
+// Upper limit for the workspace.count setting, given by the width of
+// WorkspaceSet's occupancy bitmap.
+const unsigned int kMaxWorkspaceCount = 64;
 
 extern Display* x_display;
 extern int x_screen_index;
@@ -31,8 +41,10 @@ extern XIM x_im;
 extern XIC x_ic;
 extern int x_damage_eventbase;
 extern int x_damage_errorbase;
+extern int x_randr_eventbase;
 
 class Session;
+struct CompositeJob;
 
 extern Session current_session;
 
@@ -45,12 +57,22 @@ class Rectangle : public XRectangle {
     height = 0;
   }
 
+  bool operator==(const Rectangle& other) const {
+    return x == other.x && y == other.y && width == other.width &&
+           height == other.height;
+  }
+
+  bool intersects(const Rectangle& other) const {
+    return x < other.x + other.width && other.x < x + width &&
+           y < other.y + other.height && other.y < y + height;
+  }
+
   void union_rect(const Rectangle& other) {
     if (x > other.x) x = other.x;
     if (y > other.y) y = other.y;
     if (x + width < other.x + other.width) width = (other.x + other.width) - x;
-    if (y + height < other.y + other.width)
-      height = (other.y + other.width) - y;
+    if (y + height < other.y + other.height)
+      height = (other.y + other.height) - y;
   }
 };
 
@@ -81,18 +103,87 @@ class Window {
   void ReadProperties();
   void constrain_size();
 
+  // Apply property values that were fetched elsewhere, e.g. in one batch
+  // for many windows.  `window_type` is the first _NET_WM_WINDOW_TYPE atom,
+  // or None.
+  void SetWMHints(const XWMHints& wm_hints);
+  void SetType(Atom window_type, ::Window transient_for);
+  void SetName(const XTextProperty& text_prop);
+  void SetName(std::string name) { name_ = std::move(name); }
+  void SetPID(pid_t pid) { pid_ = pid; }
+  void SetProperties(std::vector<Atom> properties) {
+    properties_ = std::move(properties);
+  }
+
+  // Sets the ICCCM WM_STATE property, e.g. to NormalState, when queued
+  // properties are next flushed.
+  void SetWMState(unsigned long state);
+
   void init_composite();
+  // Like init_composite(), for a window whose visual is already known.
+  void init_composite(Visual* visual);
   void reset_composite();
 
+  // Returns a second picture of the window with `transform` and a bilinear
+  // filter, for drawing scaled thumbnails without touching x_picture.  It
+  // is created on first use and whenever `transform` changes.
+  Picture ThumbnailPicture(const XTransform& transform);
+
   void show();
   void hide();
 
   void GetName();
 
+  // Reads _NET_WM_PID.
+  void GetPID();
+
+  // Reads _NET_WM_STRUT_PARTIAL, or the older _NET_WM_STRUT if the window
+  // has no partial strut.
+  void GetStrut();
+
+  // Sets the strut from the `count` values of _NET_WM_STRUT_PARTIAL (12)
+  // or _NET_WM_STRUT (4), or clears it if `count` is anything else.
+  void SetStrut(const unsigned long* values, size_t count);
+
+  // The space the window reserves along the edges of the root window, as
+  // the 12 values of _NET_WM_STRUT_PARTIAL.  All zero for most windows.
+  const std::array<unsigned long, 12>& Strut() const { return strut_; }
+
+  bool HasStrut() const {
+    return strut_[0] || strut_[1] || strut_[2] || strut_[3];
+  }
+
   bool AcceptsInput() const { return accepts_input_; }
 
+  // Makes `list` the focus list of the window's workspace, or removes the
+  // window from focus lists if null.  The window is linked at the front of
+  // the list while it is mapped and accepts input.
+  void SetFocusList(Window** list);
+
+  // Moves the window to the front of its focus list, if it is in one.
+  void MarkFocused();
+
+  void SetMapped(bool mapped);
+  bool Mapped() const { return mapped_; }
+
+  // The next less recently focused window in the same focus list.
+  Window* NextInFocusList() const { return focus_next_; }
+
+  // The window title, or an empty string.
+  const std::string& Name() const { return name_; }
+
+  // The process that owns the window according to _NET_WM_PID, or 0.
+  pid_t PID() const { return pid_; }
+
   WindowType Type() const { return type; }
 
+  // True if the window's picture has no alpha channel, so that it can be
+  // copied with PictOpSrc and hides whatever is below it.
+  bool Opaque() const {
+    return !x_format || x_format->type != PictTypeDirect ||
+           !x_format->direct.alphaMask;
+  }
+
   const std::vector<Atom> Properties() const { return properties_; }
 
   std::string Description() const {
@@ -119,6 +210,8 @@ class Window {
 
   ::Window x_window = 0;
   Picture x_picture = 0;
+  Visual* x_visual = nullptr;
+  XRenderPictFormat* x_format = nullptr;
   Damage x_damage = 0;
 
   ::Window x_transient_for = 0;
@@ -131,43 +224,199 @@ class Window {
 
   std::string name_;
 
+  pid_t pid_ = 0;
+
+  std::array<unsigned long, 12> strut_ = {};
+
+  // Links of the intrusive focus list of the window's workspace.
+  Window** focus_list_ = nullptr;
+  Window* focus_prev_ = nullptr;
+  Window* focus_next_ = nullptr;
+  bool in_focus_list_ = false;
+
+  bool mapped_ = false;
+
+  void LinkFocus();
+  void UnlinkFocus();
+
+  // Links or unlinks the window according to its state.
+  void UpdateFocusLink();
+
+  Picture x_thumbnail_picture_ = 0;
+  XTransform thumbnail_transform_;
+
   bool accepts_input_ = true;
 };
 
-typedef std::vector<Window*> workspace;
+// The windows of a workspace, bottom to top.  Those that can take focus
+// are also linked into `focus_list`, most recently focused first, so that
+// choosing a window to focus takes constant time.  Windows point into the
+// list, so workspaces are never copied or moved.
+struct workspace : std::vector<Window*> {
+  workspace() = default;
+  workspace(const workspace& rhs) = delete;
+  workspace& operator=(const workspace& rhs) = delete;
+
+  // Returns the window that should get focus, or null.
+  Window* FocusCandidate() const { return focus_list; }
+
+  Window* focus_list = nullptr;
+};
+
+// The workspaces of one screen.  Only workspaces that hold windows are
+// stored, and bit N of the occupancy bitmap is set while workspace N is.
+// Pointers to stored workspaces stay valid until they are pruned.
+class WorkspaceSet {
+ public:
+  typedef std::map<unsigned int, workspace>::iterator iterator;
+  typedef std::map<unsigned int, workspace>::const_iterator const_iterator;
+
+  // Returns the windows of workspace `index`, or an empty list if it is not
+  // stored.
+  const workspace& operator[](unsigned int index) const;
+
+  // Returns workspace `index` for modification, storing it if necessary.
+  // Call Prune() after removing windows from it.
+  workspace& Get(unsigned int index);
+
+  // Forgets workspace `index` if it has become empty.
+  void Prune(unsigned int index);
+
+  // Exchanges the windows of two workspaces.
+  void Swap(unsigned int a, unsigned int b);
+
+  bool Empty(unsigned int index) const {
+    return !(occupied_ & (UINT64_C(1) << index)) || (*this)[index].empty();
+  }
+
+  // Returns the first empty workspace below `count`, searching upwards from
+  // `first` and then from zero, or -1 if all are occupied.
+  int FindFree(unsigned int first, unsigned int count) const;
+
+  uint64_t Occupied() const { return occupied_; }
+
+  // Iterates over the stored workspaces, in index order.
+  iterator begin() { return windows_.begin(); }
+  iterator end() { return windows_.end(); }
+  const_iterator begin() const { return windows_.begin(); }
+  const_iterator end() const { return windows_.end(); }
+
+ private:
+  std::map<unsigned int, workspace> windows_;
+  uint64_t occupied_ = 0;
+};
 
 class Screen {
  public:
-  Screen() : x_damage_region(0), active_workspace(0) {}
+  Screen()
+      : x_window(0),
+        x_picture(0),
+        x_buffer(0),
+        x_buffer_pixmap(0),
+        x_damage_region(0),
+        active_workspace(0),
+        dirty(false) {}
 
   void paint();
 
   void UpdateFocus(unsigned int workspace_index, Time x_event_time);
 
+  // Creates the window we composite into, its back buffer and the menu's
+  // resize buffers, sized for the current geometry.  `receive_keys` selects
+  // key events on the window.
+  void AllocateBuffers(bool receive_keys);
+
+  // Frees everything created by AllocateBuffers().  They are allocated again
+  // on the next paint.
+  void ReleaseBuffers();
+
+  // Sets the position of `w` according to its type and this screen's work
+  // area.  Docks keep the position they asked for.
+  void PlaceWindow(Window* w);
+
+  // Moves the windows of `windows`, which belongs to another screen or is
+  // about to be pruned, into the first free workspace below `count`, or
+  // into `fallback` if there is none.  Returns the workspace used.
+  unsigned int AdoptWindows(workspace& windows, unsigned int fallback,
+                            unsigned int count);
+
+  // Moves the windows of workspaces numbered `count` and above into lower
+  // ones, after the workspace count has been reduced.  Returns true if the
+  // active workspace changed.
+  bool FitWorkspaces(unsigned int count);
+
   std::vector<Window*> ancillary_windows;
 
+  // Zero until the first paint after the screen appears or changes size.
   ::Window x_window;
   Picture x_picture;
   Picture x_buffer;
+  Pixmap x_buffer_pixmap;
 
   XserverRegion x_damage_region;
 
   Rectangle geometry;
 
-  workspace workspaces[24];
+  // The part of `geometry` that dock struts leave for other windows.  Kept
+  // up to date by Session::UpdateWorkAreas().
+  Rectangle work_area;
+
+  WorkspaceSet workspaces;
   unsigned int active_workspace;
 
   std::vector<Picture> resize_buffers;
   XTransform initial_transform;
 
   std::vector<unsigned int> navigation_stack;
+
+  // Set when the screen needs a full repaint.
+  bool dirty;
+
+  // While switching workspaces with an animation, a snapshot of the
+  // outgoing workspace, which slides out in `transition_direction` (-1 for
+  // left, 1 for right) as the incoming one slides in.  Zero otherwise.
+  Picture transition_picture = 0;
+  int transition_direction = 0;
+  unsigned long long transition_start_ms = 0;
 };
 
 class Session {
  public:
   void ProcessXCreateWindowEvent(const XCreateWindowEvent& cwe);
 
+  // Takes over the windows that existed before we started, e.g. after a
+  // crash or restart.  Their properties are fetched with one batch of
+  // requests, and mapped ones are placed into workspaces in stacking order.
+  // Windows that are already tracked are skipped, and tracked windows that
+  // no longer exist are forgotten.
+  void AdoptExistingWindows();
+
+  // Writes the screens, workspaces, windows and child processes to
+  // `output`, so that the process we exec() into can pick up where we left
+  // off.
+  void SaveState(FILE* output);
+
+  // Rebuilds the state written by SaveState(), without asking the X server
+  // about the windows again.  Call before AdoptExistingWindows().  Returns
+  // false if `input` is malformed, after restoring what it could.
+  bool RestoreState(FILE* input);
+
+  // Requests a full repaint of every screen.
   void SetDirty() { repaint_all_ = true; }
+
+  // Requests a full repaint of `screen` only.
+  void SetDirty(Screen* screen) {
+    screen->dirty = true;
+    repaint_screens_ = true;
+  }
+
+  // Requests a full repaint of the screens that overlap `area`.
+  void SetDirty(const Rectangle& area) {
+    for (auto& screen : screens_) {
+      if (screen.geometry.intersects(area)) SetDirty(&screen);
+    }
+  }
+
   void SetDamaged() { repaint_some_ = true; }
   void Paint();
 
@@ -182,14 +431,27 @@ class Session {
     desktop_geometry_ = geometry;
   }
 
-  void AddScreen(const Screen& new_screen) {
-    if (screens_.empty())
-      desktop_geometry_ = new_screen.geometry;
-    else
-      desktop_geometry_.union_rect(new_screen.geometry);
+  // Rebuilds the screen list after outputs have been added, removed or
+  // resized.  Screens keep their workspaces where possible; the workspaces
+  // of removed screens are moved to the first screen.  Returns false if
+  // nothing changed.
+  bool UpdateScreens(const std::vector<Rectangle>& geometries);
 
-    screens_.push_back(new_screen);
-  }
+  // Applies a changed workspace.count setting to every screen.
+  void FitWorkspaces();
+
+  // Call when a dock has appeared, disappeared or changed its strut.  The
+  // work areas are recomputed once, by the next UpdateWorkAreas().
+  void StrutsChanged() { work_areas_valid_ = false; }
+
+  // Recomputes the work areas of all screens if a strut has changed since
+  // the last call, and refits the windows of screens whose work area
+  // changed.  Cheap otherwise.
+  void UpdateWorkAreas();
+
+  // Returns the screen containing the center of `position`, or the active
+  // one.
+  Screen* ScreenAt(const Rectangle& position);
 
   size_t ScreenCount() { return screens_.size(); }
   Screen* GetScreen(size_t i) { return &screens_[i]; }
@@ -201,28 +463,71 @@ class Session {
     internal_x_windows_.insert(window);
   }
 
+  void RemoveInternalXWindow(::Window window) {
+    internal_x_windows_.erase(window);
+  }
+
   bool WindowIsInternal(::Window window) {
     return internal_x_windows_.count(window) > 0;
   }
 
-  void ShowMenu() {
-    showing_menu_ = true;
-    SetDirty();
-  }
-  void HideMenu() {
-    showing_menu_ = false;
-    SetDirty();
-  }
+  // Showing the menu also starts a timer that updates its clock every
+  // second.
+  void ShowMenu();
+  void HideMenu();
+
+  // Starts sliding from the workspace currently shown on `screen` to the one
+  // about to be shown, if workspace.animation is enabled.  `direction` is
+  // positive when moving to a higher workspace.
+  void StartTransition(Screen* screen, int direction);
+
+  // Completes all workspace transitions at once, e.g. because input arrived.
+  void FinishTransitions();
+
+  // The part of the desktop not reserved by dock struts, as published in
+  // _NET_WORKAREA.
+  const Rectangle& WorkArea() const { return work_area_; }
 
   int Top() { return desktop_geometry_.y; }
   int Right() { return desktop_geometry_.x + desktop_geometry_.width; }
   int Down() { return desktop_geometry_.y + desktop_geometry_.height; }
   int Left() { return desktop_geometry_.x; }
 
-  bool Dirty() const { return repaint_all_ || repaint_some_; }
+  bool Dirty() const {
+    return repaint_all_ || repaint_screens_ || repaint_some_ || clock_dirty_;
+  }
 
  private:
+  // Starts tracking `x_window`, without adding it to any list.
+  Window* NewWindow(::Window x_window, const Rectangle& position,
+                    bool override_redirect);
+
+  // Sets the work area of every screen from the struts of the docks, and
+  // publishes _NET_WORKAREA.  Screens whose work area changed are added to
+  // `changed`, if given.
+  void ComputeWorkAreas(std::vector<Screen*>* changed);
+
+  // Returns the part of `area` not reserved by any dock strut.
+  Rectangle SubtractStruts(const Rectangle& area) const;
+
+  // Returns the layers of `screen` to composite, without drawing anything.
+  CompositeJob BuildCompositeJob(const Screen& screen);
+
+  // Redraws only the menu clock of `screen`, clipped to its area.
+  void PaintClock(Screen& screen);
+
+  void ScheduleClockUpdate();
+
+  // Frame clock for workspace transitions.  `deadline_ms` is when the frame
+  // was due.
+  void ScheduleAnimationFrame();
+  void AnimationFrame(unsigned long long deadline_ms);
+
+  // Frees the transition snapshot of `screen`.
+  void EndTransition(Screen* screen);
+
   Rectangle desktop_geometry_;
+  Rectangle work_area_;
 
   std::vector<Screen> screens_;
   unsigned int active_screen_ = 0;
@@ -233,7 +538,16 @@ class Session {
 
   bool showing_menu_ = false;
   bool repaint_all_ = true;
+  bool repaint_screens_ = false;
   bool repaint_some_ = false;
+
+  // Set once a second while the menu is shown.
+  bool clock_dirty_ = false;
+  unsigned long clock_timer_ = 0;
+
+  unsigned long animation_timer_ = 0;
+
+  bool work_areas_valid_ = false;
 };
 
 } /* namespace cantera_wm */
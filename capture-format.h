@@ -0,0 +1,61 @@
+#ifndef CAPTURE_FORMAT_H_
+#define CAPTURE_FORMAT_H_ 1
+
+/* Layout of the screen capture segment.  The ID of the System V shared
+ * memory segment is stored in the _CANTERA_WM_CAPTURE property of the root
+ * window, as a CARDINAL.  The segment is replaced, and the property updated,
+ * whenever the screen layout changes, so recorders should watch the
+ * property and check `magic` after attaching.  */
+
+#include <stdint.h>
+
+#define CAPTURE_MAGIC 0x434d5743 /* "CWMC" */
+#define CAPTURE_VERSION 1
+
+#define CAPTURE_MAX_SCREENS 8
+#define CAPTURE_MAX_DAMAGE 16
+
+struct capture_rect {
+  int32_t x, y;
+  uint32_t width, height;
+};
+
+struct capture_screen {
+  /* Odd while the pixels or metadata of this screen are being written.
+   * Readers should copy what they need, then check that `sequence` is even
+   * and unchanged.  */
+  uint32_t sequence;
+
+  /* Position on the desktop, and size in pixels.  */
+  int32_t x, y;
+  uint32_t width, height;
+
+  /* Pixels are 32-bit words in the X server's native byte order, holding
+   * 0x00RRGGBB, `stride` bytes apart per row, starting `offset` bytes from
+   * the start of the segment.  */
+  uint32_t stride;
+  uint64_t offset;
+
+  /* Value of `frame` in the header when this screen last changed.  */
+  uint64_t frame;
+
+  /* Areas changed in that frame, relative to the screen.  If
+   * `damage_count` exceeds CAPTURE_MAX_DAMAGE, the whole screen should be
+   * treated as changed.  */
+  uint32_t damage_count;
+  struct capture_rect damage[CAPTURE_MAX_DAMAGE];
+};
+
+struct capture_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t screen_count;
+
+  /* Incremented after every painted frame.  */
+  uint64_t frame;
+
+  struct capture_screen screens[CAPTURE_MAX_SCREENS];
+};
+
+#endif /* !CAPTURE_FORMAT_H_ */
@@ -0,0 +1,333 @@
+#include "capture.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+#include "cantera-wm.h"
+#include "capture-format.h"
+#include "log.h"
+#include "settings.h"
+#include "xa.h"
+
+namespace cantera_wm {
+
+namespace {
+
+// Where the pixels of one screen go.  With shared pixmaps, the server
+// copies damaged areas into `pixmap` directly; otherwise the whole screen
+// is read into `image`.
+struct CaptureTarget {
+  Rectangle geometry;
+  Pixmap pixmap = None;
+  GC gc = None;
+  XImage* image = nullptr;
+};
+
+XShmSegmentInfo segment;
+capture_header* header;
+std::vector<CaptureTarget> targets;
+
+// Set when the X server lacks MIT-SHM, so that we only try once.
+bool capture_unavailable;
+
+bool shared_pixmaps;
+
+// Screens captured since the last FinishCaptureFrame().
+bool frame_captured;
+
+std::string frame_dump_directory;
+unsigned long frame_dump_counter;
+
+int MaskShift(unsigned long mask) { return mask ? __builtin_ctzl(mask) : 0; }
+
+// XDestroyImage is a macro.
+void DestroyImage(XImage* image) { XDestroyImage(image); }
+
+void DumpScreen(size_t screen_index, const Screen& screen) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/frame-%06lu-%zu.ppm",
+           frame_dump_directory.c_str(), frame_dump_counter, screen_index);
+
+  std::unique_ptr<XImage, decltype(&DestroyImage)> image(
+      XGetImage(x_display, screen.x_buffer_pixmap, 0, 0, screen.geometry.width,
+                screen.geometry.height, AllPlanes, ZPixmap),
+      DestroyImage);
+
+  if (!image) {
+    LOG(kWarning, "Failed to read screen %zu for %s", screen_index, path);
+    return;
+  }
+
+  std::unique_ptr<FILE, decltype(&fclose)> output(fopen(path, "w"), fclose);
+
+  if (!output) {
+    LOG(kWarning, "%s: %s", path, strerror(errno));
+    return;
+  }
+
+  int red_shift = MaskShift(image->red_mask);
+  int green_shift = MaskShift(image->green_mask);
+  int blue_shift = MaskShift(image->blue_mask);
+
+  fprintf(output.get(), "P6\n%d %d\n255\n", image->width, image->height);
+
+  std::vector<unsigned char> row(image->width * 3);
+
+  for (int y = 0; y < image->height; ++y) {
+    for (int x = 0; x < image->width; ++x) {
+      unsigned long pixel = XGetPixel(image.get(), x, y);
+
+      row[x * 3] = (pixel & image->red_mask) >> red_shift;
+      row[x * 3 + 1] = (pixel & image->green_mask) >> green_shift;
+      row[x * 3 + 2] = (pixel & image->blue_mask) >> blue_shift;
+    }
+
+    fwrite(row.data(), 1, row.size(), output.get());
+  }
+
+  if (ferror(output.get())) LOG(kWarning, "%s: write error", path);
+}
+
+void ReleaseSegment() {
+  if (!header) return;
+
+  XDeleteProperty(x_display, x_root_window, xa::cantera_wm_capture);
+
+  for (auto& target : targets) {
+    if (target.gc) XFreeGC(x_display, target.gc);
+    if (target.pixmap) XFreePixmap(x_display, target.pixmap);
+
+    if (target.image) {
+      // The pixels belong to the segment.
+      target.image->data = nullptr;
+      XDestroyImage(target.image);
+    }
+  }
+
+  targets.clear();
+
+  XShmDetach(x_display, &segment);
+  XSync(x_display, False);
+
+  shmdt(segment.shmaddr);
+
+  header = nullptr;
+}
+
+// Returns true if the segment matches the current screen layout, replacing
+// it first if necessary.
+bool UpdateSegment() {
+  size_t screen_count =
+      std::min<size_t>(current_session.ScreenCount(), CAPTURE_MAX_SCREENS);
+
+  if (header && targets.size() == screen_count &&
+      std::equal(targets.begin(), targets.end(), current_session.GetScreen(0),
+                 [](const auto& target, const auto& screen) {
+                   return target.geometry == screen.geometry;
+                 }))
+    return true;
+
+  ReleaseSegment();
+
+  if (capture_unavailable) return false;
+
+  int major, minor;
+  Bool pixmaps;
+
+  if (!XShmQueryVersion(x_display, &major, &minor, &pixmaps)) {
+    LOG(kWarning, "MIT-SHM is not available; screen capture disabled");
+    capture_unavailable = true;
+    return false;
+  }
+
+  shared_pixmaps = pixmaps && XShmPixmapFormat(x_display) == ZPixmap;
+
+  if (current_session.ScreenCount() > CAPTURE_MAX_SCREENS)
+    LOG(kWarning, "Only the first %d screens are captured",
+        CAPTURE_MAX_SCREENS);
+
+  unsigned int depth = x_visual_info->depth;
+  size_t size = (sizeof(capture_header) + 4095) & ~4095;
+  targets.resize(screen_count);
+
+  capture_header layout;
+  memset(&layout, 0, sizeof(layout));
+
+  for (size_t i = 0; i < screen_count; ++i) {
+    const auto& geometry = current_session.GetScreen(i)->geometry;
+    auto& info = layout.screens[i];
+
+    targets[i].geometry = geometry;
+
+    info.x = geometry.x;
+    info.y = geometry.y;
+    info.width = geometry.width;
+    info.height = geometry.height;
+    info.stride = geometry.width * 4;
+    info.offset = size;
+
+    size += (size_t)info.stride * info.height;
+  }
+
+  if (-1 == (segment.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600))) {
+    LOG(kWarning, "shmget: %s", strerror(errno));
+    targets.clear();
+    return false;
+  }
+
+  segment.shmaddr = reinterpret_cast<char*>(shmat(segment.shmid, nullptr, 0));
+  segment.readOnly = False;
+
+  if (segment.shmaddr == reinterpret_cast<char*>(-1)) {
+    LOG(kWarning, "shmat: %s", strerror(errno));
+    shmctl(segment.shmid, IPC_RMID, nullptr);
+    targets.clear();
+    return false;
+  }
+
+  if (!XShmAttach(x_display, &segment)) {
+    LOG(kWarning, "XShmAttach failed; screen capture disabled");
+    shmdt(segment.shmaddr);
+    shmctl(segment.shmid, IPC_RMID, nullptr);
+    targets.clear();
+    capture_unavailable = true;
+    return false;
+  }
+
+  XSync(x_display, False);
+
+  // The segment is destroyed when the last process detaches from it, even
+  // if we crash.  Linux still lets recorders attach to it until then.
+  shmctl(segment.shmid, IPC_RMID, nullptr);
+
+  header = reinterpret_cast<capture_header*>(segment.shmaddr);
+
+  for (size_t i = 0; i < screen_count; ++i) {
+    const auto& info = layout.screens[i];
+    char* pixels = segment.shmaddr + info.offset;
+
+    if (shared_pixmaps) {
+      targets[i].pixmap =
+          XShmCreatePixmap(x_display, x_root_window, pixels, &segment,
+                           info.width, info.height, depth);
+      targets[i].gc = XCreateGC(x_display, targets[i].pixmap, 0, nullptr);
+    } else {
+      targets[i].image =
+          XShmCreateImage(x_display, x_visual, depth, ZPixmap, pixels,
+                          &segment, info.width, info.height);
+    }
+  }
+
+  layout.magic = CAPTURE_MAGIC;
+  layout.version = CAPTURE_VERSION;
+  layout.header_size = sizeof(capture_header);
+  layout.screen_count = screen_count;
+
+  memcpy(header, &layout, sizeof(layout));
+
+  unsigned long shmid = segment.shmid;
+  XChangeProperty(x_display, x_root_window, xa::cantera_wm_capture,
+                  XA_CARDINAL, 32, PropModeReplace,
+                  reinterpret_cast<unsigned char*>(&shmid), 1);
+
+  LOG(kInfo, "Capturing %zu screen(s) to shared memory segment %d%s",
+      screen_count, segment.shmid,
+      shared_pixmaps ? "" : " (without shared pixmaps)");
+
+  return true;
+}
+
+}  // namespace
+
+void SetFrameDumpDirectory(const std::string& directory) {
+  frame_dump_directory = directory;
+}
+
+bool CaptureEnabled() {
+  return settings.capture_screens || !frame_dump_directory.empty();
+}
+
+void CaptureScreen(size_t screen_index, const Screen& screen,
+                   const std::vector<XRectangle>& damage) {
+  if (!frame_dump_directory.empty()) {
+    DumpScreen(screen_index, screen);
+    frame_captured = true;
+  }
+
+  if (!settings.capture_screens || screen_index >= CAPTURE_MAX_SCREENS)
+    return;
+
+  if (!UpdateSegment()) return;
+
+  auto& target = targets[screen_index];
+  auto& info = header->screens[screen_index];
+
+  uint32_t sequence = __atomic_load_n(&info.sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&info.sequence, sequence + 1, __ATOMIC_RELAXED);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  if (target.pixmap && !damage.empty()) {
+    for (const auto& rect : damage) {
+      XCopyArea(x_display, screen.x_buffer_pixmap, target.pixmap, target.gc,
+                rect.x, rect.y, rect.width, rect.height, rect.x, rect.y);
+    }
+
+    XSync(x_display, False);
+  } else if (target.pixmap) {
+    XCopyArea(x_display, screen.x_buffer_pixmap, target.pixmap, target.gc, 0,
+              0, screen.geometry.width, screen.geometry.height, 0, 0);
+
+    XSync(x_display, False);
+  } else {
+    XShmGetImage(x_display, screen.x_buffer_pixmap, target.image, 0, 0,
+                 AllPlanes);
+  }
+
+  info.frame = header->frame + 1;
+  info.damage_count = damage.size();
+
+  for (size_t i = 0; i < damage.size() && i < CAPTURE_MAX_DAMAGE; ++i) {
+    info.damage[i].x = damage[i].x;
+    info.damage[i].y = damage[i].y;
+    info.damage[i].width = damage[i].width;
+    info.damage[i].height = damage[i].height;
+  }
+
+  if (damage.empty()) {
+    info.damage_count = 1;
+    info.damage[0].x = 0;
+    info.damage[0].y = 0;
+    info.damage[0].width = screen.geometry.width;
+    info.damage[0].height = screen.geometry.height;
+  }
+
+  __atomic_store_n(&info.sequence, sequence + 2, __ATOMIC_RELEASE);
+
+  frame_captured = true;
+}
+
+void FinishCaptureFrame() {
+  if (!settings.capture_screens) ReleaseSegment();
+
+  if (!frame_captured) return;
+
+  frame_captured = false;
+
+  ++frame_dump_counter;
+
+  if (header)
+    __atomic_store_n(&header->frame, header->frame + 1, __ATOMIC_RELEASE);
+}
+
+}  // namespace cantera_wm
@@ -0,0 +1,37 @@
+#ifndef CAPTURE_H_
+#define CAPTURE_H_ 1
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <X11/Xlib.h>
+
+namespace cantera_wm {
+
+class Screen;
+
+// Makes CaptureScreen() also write every painted screen to `directory`, as
+// binary PPM files named frame-NNNNNN-S.ppm after the frame and screen
+// number.  Meant for comparing rendering against reference images with
+// frame-diff.
+void SetFrameDumpDirectory(const std::string& directory);
+
+// Returns true if painted screens should be passed to CaptureScreen().
+bool CaptureEnabled();
+
+// Copies the back buffer of screen `screen_index`, which has just been
+// painted, into the capture segment described in capture-format.h.
+// `damage` holds the changed areas relative to the screen; an empty list
+// means the whole screen.
+void CaptureScreen(size_t screen_index, const Screen& screen,
+                   const std::vector<XRectangle>& damage);
+
+// Marks the end of a painted frame, publishing the screens captured since
+// the previous call.  Releases the capture segment if capturing has been
+// disabled.
+void FinishCaptureFrame();
+
+}  // namespace cantera_wm
+
+#endif  // !CAPTURE_H_
@@ -0,0 +1,185 @@
+#include "compositor.h"
+
+#include <condition_variable>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "cantera-wm.h"
+#include "log.h"
+
+namespace cantera_wm {
+
+namespace {
+
+bool parallel_compositing;
+
+// Paints one screen on a connection of its own.
+class CompositorThread {
+ public:
+  CompositorThread() {
+    if (!(display_ = XOpenDisplay(DisplayString(x_display)))) {
+      LOG(kError, "Failed to open X connection for compositing thread");
+      return;
+    }
+
+    thread_ = std::thread(&CompositorThread::Run, this);
+  }
+
+  ~CompositorThread() {
+    if (!display_) return;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+
+    cv_.notify_all();
+    thread_.join();
+
+    XCloseDisplay(display_);
+  }
+
+  CompositorThread(const CompositorThread& rhs) = delete;
+  CompositorThread& operator=(const CompositorThread& rhs) = delete;
+
+  bool Connected() const { return display_ != nullptr; }
+
+  void Submit(CompositeJob job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !have_job_; });
+
+    job_ = std::move(job);
+    have_job_ = true;
+
+    lock.unlock();
+    cv_.notify_all();
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !have_job_ && !busy_; });
+  }
+
+ private:
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    for (;;) {
+      cv_.wait(lock, [this] { return have_job_ || stop_; });
+
+      if (stop_) return;
+
+      CompositeJob job = std::move(job_);
+      have_job_ = false;
+      busy_ = true;
+
+      lock.unlock();
+      cv_.notify_all();
+
+      job.Draw(display_);
+      job.Present(display_);
+      XSync(display_, False);
+
+      lock.lock();
+      busy_ = false;
+      cv_.notify_all();
+    }
+  }
+
+  Display* display_ = nullptr;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+
+  CompositeJob job_;
+  bool have_job_ = false;
+  bool busy_ = false;
+  bool stop_ = false;
+
+  std::thread thread_;
+};
+
+std::vector<std::unique_ptr<CompositorThread>> compositor_threads;
+
+}  // namespace
+
+void CompositeJob::CullOccluded() {
+  for (auto i = layers.rbegin(); i != layers.rend(); ++i) {
+    if (!i->opaque || i->x > 0 || i->y > 0 ||
+        i->x + static_cast<int>(i->width) < static_cast<int>(width) ||
+        i->y + static_cast<int>(i->height) < static_cast<int>(height))
+      continue;
+
+    layers.erase(layers.begin(), std::prev(i.base()));
+    clear = false;
+
+    return;
+  }
+}
+
+void CompositeJob::Draw(Display* display) const {
+  if (clear) {
+    XRenderColor black;
+
+    black.red = 0x0000;
+    black.green = 0x0000;
+    black.blue = 0x0000;
+    black.alpha = 0xffff;
+
+    XRenderFillRectangle(display, PictOpSrc, x_buffer, &black, 0, 0, width,
+                         height);
+  }
+
+  for (const auto& layer : layers) {
+    XRenderComposite(display, layer.opaque ? PictOpSrc : PictOpOver,
+                     layer.picture, None, x_buffer, layer.source_x,
+                     layer.source_y, 0, 0, layer.x, layer.y, layer.width,
+                     layer.height);
+  }
+}
+
+void CompositeJob::Present(Display* display) const {
+  XRenderComposite(display, PictOpSrc, x_buffer, None, x_picture, 0, 0, 0, 0,
+                   0, 0, width, height);
+}
+
+void CompositeJob::Present(Display* display, const XRectangle& area) const {
+  XRenderComposite(display, PictOpSrc, x_buffer, None, x_picture, area.x,
+                   area.y, 0, 0, area.x, area.y, area.width, area.height);
+}
+
+void EnableParallelCompositing() {
+  if (!XInitThreads()) {
+    LOG(kWarning, "Xlib lacks thread support; compositing serially");
+    return;
+  }
+
+  parallel_compositing = true;
+}
+
+bool ParallelCompositingEnabled() { return parallel_compositing; }
+
+void SubmitCompositeJob(size_t screen_index, CompositeJob job) {
+  while (compositor_threads.size() <= screen_index)
+    compositor_threads.emplace_back(new CompositorThread);
+
+  auto& thread = *compositor_threads[screen_index];
+
+  if (!thread.Connected()) {
+    job.Draw(x_display);
+    job.Present(x_display);
+    return;
+  }
+
+  thread.Submit(std::move(job));
+}
+
+void WaitForCompositeJobs() {
+  for (auto& thread : compositor_threads) {
+    if (thread->Connected()) thread->Wait();
+  }
+}
+
+}  // namespace cantera_wm
@@ -0,0 +1,70 @@
+#ifndef COMPOSITOR_H_
+#define COMPOSITOR_H_ 1
+
+#include <cstddef>
+#include <vector>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrender.h>
+
+namespace cantera_wm {
+
+// A window picture to composite, with its destination relative to the
+// screen.
+struct CompositeLayer {
+  Picture picture;
+  int x, y;
+  unsigned int width, height;
+
+  // The part of `picture` to draw starts here.
+  int source_x = 0, source_y = 0;
+
+  // Opaque layers are copied with PictOpSrc and hide the layers below;
+  // others are blended with PictOpOver.
+  bool opaque;
+};
+
+// Everything needed to paint one screen, by XID only, so that it can be
+// executed on any X connection.
+struct CompositeJob {
+  Picture x_buffer;
+  Picture x_picture;
+  unsigned int width, height;
+
+  // Bottom to top.
+  std::vector<CompositeLayer> layers;
+
+  // Whether the buffer must be cleared before drawing the layers.
+  bool clear = true;
+
+  // Drops the layers that are hidden below an opaque layer covering the
+  // whole screen.
+  void CullOccluded();
+
+  // Clears the back buffer and composites the layers into it.
+  void Draw(Display* display) const;
+
+  // Copies the back buffer to the screen window.
+  void Present(Display* display) const;
+
+  // Copies only `area` of the back buffer to the screen window.
+  void Present(Display* display, const XRectangle& area) const;
+};
+
+// Prepares Xlib for per-screen compositing threads.  Must be called before
+// any other Xlib function.
+void EnableParallelCompositing();
+
+bool ParallelCompositingEnabled();
+
+// Draws and presents `job` on the compositing thread of screen
+// `screen_index`, which has its own X connection.  Waits for that thread's
+// previous job to be picked up first.
+void SubmitCompositeJob(size_t screen_index, CompositeJob job);
+
+// Waits until the X server has executed every submitted job.
+void WaitForCompositeJobs();
+
+}  // namespace cantera_wm
+
+#endif  // !COMPOSITOR_H_
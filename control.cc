@@ -0,0 +1,424 @@
+#include "control.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cantera-wm.h"
+#include "event-loop.h"
+#include "launcher.h"
+#include "log.h"
+#include "settings.h"
+
+namespace cantera_wm {
+
+namespace {
+
+// Larger batches are rejected as a whole.
+const size_t kMaxBatchSize = 64 * 1024;
+
+int listen_fd = -1;
+
+// Connected clients by ID.  Replies look the client up by ID, so that a
+// reply for a client that has gone away is never sent to another one that
+// was given the same descriptor.
+std::map<unsigned long, int> clients;
+unsigned long next_client_id = 1;
+
+// The replies of one batch, sent when the last of them is known.
+struct Batch {
+  unsigned long client_id;
+  std::vector<std::string> replies;
+
+  // Launches still waiting for a pid, plus one while commands are being
+  // applied.
+  size_t pending = 1;
+};
+
+void FinishReply(const std::shared_ptr<Batch>& batch) {
+  if (--batch->pending) return;
+
+  auto i = clients.find(batch->client_id);
+  if (i == clients.end()) return;
+
+  std::string message;
+
+  for (const auto& reply : batch->replies) {
+    message += reply;
+    message += '\n';
+  }
+
+  if (-1 == send(i->second, message.data(), message.size(), MSG_NOSIGNAL))
+    LOG(kDebug, "Failed to reply to control client: %s", strerror(errno));
+}
+
+void AppendJsonString(std::string* output, const std::string& string) {
+  *output += '"';
+
+  for (auto ch : string) {
+    auto byte = static_cast<unsigned char>(ch);
+
+    if (ch == '"' || ch == '\\') {
+      *output += '\\';
+      *output += ch;
+    } else if (byte < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", byte);
+      *output += buf;
+    } else {
+      *output += ch;
+    }
+  }
+
+  *output += '"';
+}
+
+void AppendJsonWindow(std::string* output, const Window* w) {
+  char buf[128];
+
+  snprintf(buf, sizeof(buf), "{\"id\":%lu,\"pid\":%d,\"type\":", w->x_window,
+           static_cast<int>(w->PID()));
+  *output += buf;
+  AppendJsonString(output, Window::StringFromType(w->Type()));
+  *output += ",\"name\":";
+  AppendJsonString(output, w->Name());
+  *output += '}';
+}
+
+std::string Query() {
+  std::string output;
+  char buf[128];
+
+  snprintf(buf, sizeof(buf), "{\"active_screen\":%zu,\"screens\":[",
+           current_session.ActiveScreenIndex());
+  output += buf;
+
+  for (size_t i = 0; i < current_session.ScreenCount(); ++i) {
+    const auto screen = current_session.GetScreen(i);
+    const auto& geometry = screen->geometry;
+
+    if (i) output += ',';
+
+    snprintf(buf, sizeof(buf),
+             "{\"geometry\":[%d,%d,%u,%u],\"active_workspace\":%u,"
+             "\"ancillary\":[",
+             geometry.x, geometry.y, geometry.width, geometry.height,
+             screen->active_workspace);
+    output += buf;
+
+    const char* separator = "";
+
+    for (auto w : screen->ancillary_windows) {
+      output += separator;
+      AppendJsonWindow(&output, w);
+      separator = ",";
+    }
+
+    output += "],\"workspaces\":[";
+    separator = "";
+
+    for (const auto& entry : screen->workspaces) {
+      if (entry.second.empty()) continue;
+
+      snprintf(buf, sizeof(buf), "%s{\"index\":%u,\"focus\":%lu,\"windows\":[",
+               separator, entry.first,
+               entry.second.FocusCandidate()
+                   ? entry.second.FocusCandidate()->x_window
+                   : 0UL);
+      output += buf;
+      separator = ",";
+
+      // Top first, as the menu shows them.
+      for (auto w = entry.second.rbegin(); w != entry.second.rend(); ++w) {
+        if (w != entry.second.rbegin()) output += ',';
+        AppendJsonWindow(&output, *w);
+      }
+
+      output += "]}";
+    }
+
+    output += "]}";
+  }
+
+  output += "]}";
+
+  return output;
+}
+
+void ShowWorkspace(Screen* screen, unsigned int index) {
+  current_session.FinishTransitions();
+
+  screen->UpdateFocus(index, CurrentTime);
+
+  screen->navigation_stack.clear();
+  screen->navigation_stack.push_back(index);
+
+  current_session.SetDirty(screen);
+}
+
+// Applies one command.  Returns its reply, or an empty string if the reply
+// comes later.
+std::string ApplyCommand(const char* line,
+                         const std::shared_ptr<Batch>& batch, size_t index) {
+  char command[16];
+  int length = 0;
+
+  if (1 != sscanf(line, "%15s%n", command, &length)) return "error empty";
+
+  const char* args = line + length;
+  long x_window;
+  unsigned int number;
+  char extra;
+
+  if (!strcmp(command, "workspace")) {
+    if (1 != sscanf(args, "%u %c", &number, &extra))
+      return "error usage: workspace N";
+
+    if (number >= settings.workspace_count) return "error no such workspace";
+
+    ShowWorkspace(current_session.ActiveScreen(), number);
+  } else if (!strcmp(command, "screen")) {
+    if (1 != sscanf(args, "%u %c", &number, &extra))
+      return "error usage: screen N";
+
+    if (number >= current_session.ScreenCount()) return "error no such screen";
+
+    current_session.SetDirty(current_session.ActiveScreen());
+    current_session.SetActiveScreen(number);
+
+    auto screen = current_session.ActiveScreen();
+    screen->UpdateFocus(screen->active_workspace, CurrentTime);
+
+    current_session.SetDirty(screen);
+  } else if (!strcmp(command, "move")) {
+    if (2 != sscanf(args, "%li %u %c", &x_window, &number, &extra))
+      return "error usage: move XID N";
+
+    if (number >= settings.workspace_count) return "error no such workspace";
+
+    Screen* screen;
+    workspace* source;
+    auto w = current_session.find_x_window(x_window, &source, &screen);
+
+    if (!w || !source) return "error no such window in a workspace";
+
+    auto& destination = screen->workspaces.Get(number);
+
+    if (&destination == source) return "ok";
+
+    current_session.FinishTransitions();
+    current_session.move_window(w, screen, &destination);
+
+    if (number == screen->active_workspace)
+      w->show();
+    else
+      w->hide();
+
+    // Refocuses the active workspace, whichever side the window left.
+    screen->UpdateFocus(screen->active_workspace, CurrentTime);
+
+    current_session.SetDirty(screen);
+  } else if (!strcmp(command, "launch")) {
+    args += strspn(args, " \t");
+
+    if (!*args) return "error usage: launch COMMAND";
+
+    ++batch->pending;
+
+    LaunchProgram(args, current_session.ActiveScreenIndex(),
+                  current_session.ActiveScreen()->active_workspace,
+                  [batch, index](pid_t pid) {
+                    batch->replies[index] =
+                        (pid == -1) ? "error launch failed"
+                                    : "pid " + std::to_string(pid);
+                    FinishReply(batch);
+                  });
+
+    return std::string();
+  } else if (!strcmp(command, "menu")) {
+    char state[8];
+
+    if (1 != sscanf(args, "%7s %c", state, &extra) ||
+        (strcmp(state, "show") && strcmp(state, "hide")))
+      return "error usage: menu show|hide";
+
+    current_session.FinishTransitions();
+
+    if (!strcmp(state, "show"))
+      current_session.ShowMenu();
+    else
+      current_session.HideMenu();
+  } else if (!strcmp(command, "query")) {
+    return Query();
+  } else {
+    return std::string("error unknown command '") + command + "'";
+  }
+
+  return "ok";
+}
+
+void ProcessClient(unsigned long client_id, int fd) {
+  std::vector<char> buffer(kMaxBatchSize + 1);
+  ssize_t ret;
+
+  do {
+    ret = recv(fd, buffer.data(), kMaxBatchSize, MSG_DONTWAIT | MSG_TRUNC);
+  } while (ret == -1 && errno == EINTR);
+
+  if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+
+  if (ret <= 0) {
+    UnwatchFd(fd);
+    close(fd);
+    clients.erase(client_id);
+    return;
+  }
+
+  auto batch = std::make_shared<Batch>();
+  batch->client_id = client_id;
+
+  if (static_cast<size_t>(ret) > kMaxBatchSize) {
+    batch->replies.push_back("error batch too large");
+    FinishReply(batch);
+    return;
+  }
+
+  buffer[ret] = 0;
+
+  std::vector<const char*> lines;
+
+  for (char* line = buffer.data(); *line;) {
+    char* end = strchr(line, '\n');
+
+    if (end) *end = 0;
+
+    if (line[strspn(line, " \t\r")]) lines.push_back(line);
+
+    if (!end) break;
+
+    line = end + 1;
+  }
+
+  // Every reply slot exists before the first command runs, since launches
+  // may complete immediately.
+  batch->replies.resize(lines.size());
+
+  for (size_t i = 0; i < lines.size(); ++i) {
+    auto reply = ApplyCommand(lines[i], batch, i);
+
+    if (!reply.empty()) batch->replies[i] = std::move(reply);
+  }
+
+  FinishReply(batch);
+}
+
+void AcceptClient() {
+  int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+
+  if (fd == -1) return;
+
+  unsigned long client_id = next_client_id++;
+  clients[client_id] = fd;
+
+  WatchFd(fd, [client_id, fd] { ProcessClient(client_id, fd); });
+}
+
+}  // namespace
+
+void StartControlSocket() {
+  sockaddr_un address;
+  const char* runtime_directory = getenv("XDG_RUNTIME_DIR");
+  const char* display = getenv("DISPLAY");
+  std::string path;
+
+  if (runtime_directory && *runtime_directory) {
+    path = runtime_directory;
+  } else {
+    path = "/tmp/cantera-wm-" + std::to_string(getuid());
+
+    if (-1 == mkdir(path.c_str(), 0700) && errno != EEXIST) {
+      LOG(kWarning, "Failed to create '%s': %s", path.c_str(), strerror(errno));
+      return;
+    }
+
+    // Anyone can create the directory, or a symlink in its place, before
+    // we do.
+    struct stat st;
+
+    if (-1 == lstat(path.c_str(), &st) || !S_ISDIR(st.st_mode) ||
+        st.st_uid != getuid() || (st.st_mode & 0777) != 0700) {
+      LOG(kWarning,
+          "'%s' is not a directory of ours with mode 0700; not serving the "
+          "control socket",
+          path.c_str());
+      return;
+    }
+  }
+
+  path += "/cantera-wm";
+  if (display) path += display;
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (path.size() >= sizeof(address.sun_path)) {
+    LOG(kWarning, "Control socket path '%s' is too long", path.c_str());
+    return;
+  }
+
+  strcpy(address.sun_path, path.c_str());
+
+  if (-1 == (listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0))) {
+    LOG(kWarning, "Failed to create control socket: %s", strerror(errno));
+    return;
+  }
+
+  // A socket someone still answers on belongs to another window manager,
+  // which we are about to fail to replace.  Anything else is left over from
+  // an earlier run, or from before a restart.
+  int probe_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+  if (probe_fd != -1) {
+    bool in_use = (0 == connect(probe_fd, reinterpret_cast<sockaddr*>(&address),
+                                sizeof(address)));
+    close(probe_fd);
+
+    if (in_use) {
+      LOG(kWarning, "Control socket '%s' is in use", path.c_str());
+      close(listen_fd);
+      listen_fd = -1;
+      return;
+    }
+  }
+
+  unlink(path.c_str());
+
+  mode_t old_mask = umask(0077);
+  int ret = bind(listen_fd, reinterpret_cast<sockaddr*>(&address),
+                 sizeof(address));
+  umask(old_mask);
+
+  if (ret == -1 || -1 == listen(listen_fd, 16)) {
+    LOG(kWarning, "Failed to listen on '%s': %s", path.c_str(),
+        strerror(errno));
+    close(listen_fd);
+    listen_fd = -1;
+    return;
+  }
+
+  setenv("CANTERA_WM_SOCKET", path.c_str(), 1);
+
+  WatchFd(listen_fd, AcceptClient);
+}
+
+}  // namespace cantera_wm
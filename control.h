@@ -0,0 +1,28 @@
+#ifndef CONTROL_H_
+#define CONTROL_H_ 1
+
+namespace cantera_wm {
+
+// Starts serving the control socket from the main loop, and exports its
+// path to our children as CANTERA_WM_SOCKET.  Call before StartLauncher(),
+// so that programs started by the helper see the variable too.
+//
+// Clients connect with SOCK_SEQPACKET and send batches of commands, one
+// per line, in a single message:
+//
+//   workspace N        shows workspace N on the active screen
+//   screen N           makes screen N active
+//   move XID N         moves a window to workspace N of its screen
+//   launch COMMAND     starts COMMAND in the active workspace
+//   menu show|hide     shows or hides the menu, as holding Super+Alt does
+//   query              describes the screens and windows as JSON
+//
+// The whole batch is applied before the next repaint.  Its reply is one
+// message with a line per command: "ok", "error MESSAGE", "pid PID" for
+// launches or a JSON object for queries.  It is sent once every launch in
+// the batch has a pid, without blocking the main loop.
+void StartControlSocket();
+
+}  // namespace cantera_wm
+
+#endif  // !CONTROL_H_
@@ -0,0 +1,137 @@
+#include "event-loop.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <err.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace cantera_wm {
+
+namespace {
+
+std::map<int, std::function<void()>> fd_watches;
+
+// Keyed by deadline on the monotonic clock in milliseconds, then by ID.
+std::map<std::pair<unsigned long long, TimerId>, std::function<void()>> timers;
+std::map<TimerId, unsigned long long> timer_deadlines;
+TimerId next_timer_id = 1;
+
+// Read and write ends of the pipe written by WakeUp().
+int wakeup_fds[2] = {-1, -1};
+
+}  // namespace
+
+unsigned long long Now() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+void InitEventLoop() {
+  if (-1 == pipe2(wakeup_fds, O_CLOEXEC | O_NONBLOCK))
+    err(EXIT_FAILURE, "Failed to create wakeup pipe");
+}
+
+void WakeUp() {
+  if (wakeup_fds[1] == -1) return;
+
+  int saved_errno = errno;
+
+  // A full pipe already wakes the loop, so a failed write does not matter.
+  ssize_t ret = write(wakeup_fds[1], "", 1);
+  static_cast<void>(ret);
+
+  errno = saved_errno;
+}
+
+void WatchFd(int fd, std::function<void()> callback) {
+  fd_watches[fd] = std::move(callback);
+}
+
+void UnwatchFd(int fd) { fd_watches.erase(fd); }
+
+TimerId AddTimer(unsigned int delay_ms, std::function<void()> callback) {
+  TimerId id = next_timer_id++;
+  unsigned long long deadline = Now() + delay_ms;
+
+  timers[std::make_pair(deadline, id)] = std::move(callback);
+  timer_deadlines[id] = deadline;
+
+  return id;
+}
+
+void CancelTimer(TimerId id) {
+  auto i = timer_deadlines.find(id);
+  if (i == timer_deadlines.end()) return;
+
+  timers.erase(std::make_pair(i->second, id));
+  timer_deadlines.erase(i);
+}
+
+void RunTimers() {
+  unsigned long long now = Now();
+
+  // Callbacks may add and cancel timers, so look up the first one anew each
+  // time.
+  while (!timers.empty() && timers.begin()->first.first <= now) {
+    auto callback = std::move(timers.begin()->second);
+
+    timer_deadlines.erase(timers.begin()->first.second);
+    timers.erase(timers.begin());
+
+    callback();
+  }
+}
+
+void WaitForEvents(int x_fd) {
+  std::vector<pollfd> pfds;
+
+  pfds.push_back(pollfd{x_fd, POLLIN, 0});
+  pfds.push_back(pollfd{wakeup_fds[0], POLLIN, 0});
+
+  for (const auto& watch : fd_watches)
+    pfds.push_back(pollfd{watch.first, POLLIN, 0});
+
+  int timeout = -1;
+
+  if (!timers.empty()) {
+    unsigned long long deadline = timers.begin()->first.first, now = Now();
+
+    timeout = (deadline > now) ? deadline - now : 0;
+  }
+
+  if (-1 == poll(pfds.data(), pfds.size(), timeout)) {
+    if (errno == EINTR) return;
+
+    err(EXIT_FAILURE, "poll failed");
+  }
+
+  if (pfds[1].revents) {
+    char buf[64];
+
+    while (read(wakeup_fds[0], buf, sizeof(buf)) > 0) continue;
+  }
+
+  for (size_t i = 2; i < pfds.size(); ++i) {
+    if (!pfds[i].revents) continue;
+
+    // An earlier callback may have removed this watch.
+    auto watch = fd_watches.find(pfds[i].fd);
+    if (watch == fd_watches.end()) continue;
+
+    auto callback = watch->second;
+    callback();
+  }
+
+  RunTimers();
+}
+
+}  // namespace cantera_wm
@@ -0,0 +1,45 @@
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_ 1
+
+#include <functional>
+
+namespace cantera_wm {
+
+// Runs `callback` from the main loop whenever `fd` is readable or has been
+// hung up.  Replaces any earlier callback for the same descriptor.
+void WatchFd(int fd, std::function<void()> callback);
+
+void UnwatchFd(int fd);
+
+typedef unsigned long TimerId;
+
+// Returns the monotonic clock in milliseconds, the clock of timer deadlines.
+unsigned long long Now();
+
+// Runs `callback` once from the main loop after `delay_ms` milliseconds.
+// The returned ID is never zero.
+TimerId AddTimer(unsigned int delay_ms, std::function<void()> callback);
+
+// Cancels a timer that has not fired yet.  Zero is ignored.
+void CancelTimer(TimerId id);
+
+// Runs the callbacks of expired timers.
+void RunTimers();
+
+// Creates the pipe behind WakeUp().  Call before installing signal handlers
+// that use it.
+void InitEventLoop();
+
+// Makes the current or next call to WaitForEvents() return without waiting,
+// so that a flag set by a signal handler just before the main loop blocks
+// is still seen.  Async-signal-safe.
+void WakeUp();
+
+// Blocks until `x_fd` is readable, one of the watched descriptors is ready,
+// a timer expires or WakeUp() is called, and runs the callbacks of the
+// watches and timers.  Also returns when interrupted by a signal.
+void WaitForEvents(int x_fd);
+
+}  // namespace cantera_wm
+
+#endif  // !EVENT_LOOP_H_
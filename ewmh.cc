@@ -0,0 +1,234 @@
+#include "ewmh.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <X11/Xatom.h>
+
+#include "cantera-wm.h"
+#include "settings.h"
+#include "xa.h"
+
+namespace cantera_wm {
+
+namespace {
+
+// One of the window list properties.  `windows` mirrors what the property
+// will hold after the next flush.
+struct ClientList {
+  Atom* atom;
+  std::vector< ::Window> windows;
+
+  // Windows to append, if `replace` is false.
+  std::vector< ::Window> appended;
+  bool replace = false;
+
+  void Add(::Window x_window) {
+    windows.push_back(x_window);
+
+    if (!replace) appended.push_back(x_window);
+  }
+
+  void Remove(::Window x_window) {
+    auto i = std::find(windows.begin(), windows.end(), x_window);
+    if (i == windows.end()) return;
+
+    windows.erase(i);
+    appended.clear();
+    replace = true;
+  }
+
+  void Flush() {
+    if (replace) {
+      XChangeProperty(x_display, x_root_window, *atom, XA_WINDOW, 32,
+                      PropModeReplace,
+                      reinterpret_cast<unsigned char*>(windows.data()),
+                      windows.size());
+    } else if (!appended.empty()) {
+      XChangeProperty(x_display, x_root_window, *atom, XA_WINDOW, 32,
+                      PropModeAppend,
+                      reinterpret_cast<unsigned char*>(appended.data()),
+                      appended.size());
+    }
+
+    appended.clear();
+    replace = false;
+  }
+};
+
+// A 32-bit property value waiting to be written.
+struct Property {
+  Atom type;
+  std::vector<long> values;
+
+  bool operator==(const Property& other) const {
+    return type == other.type && values == other.values;
+  }
+};
+
+// The latest value queued for each window and property.
+std::map<std::pair< ::Window, Atom>, Property> queued_properties;
+
+// Root window properties as last written through the queue.  Other windows
+// come and go, so theirs are not remembered.
+std::map<Atom, Property> root_properties;
+
+::Window queued_focus = None;
+Time queued_focus_time = CurrentTime;
+
+ClientList client_list{&xa::net_client_list};
+ClientList client_list_stacking{&xa::net_client_list_stacking};
+
+// Values last written, or -1 if none.
+long current_desktop = -1;
+long number_of_desktops = -1;
+
+// Last written _NET_WORKAREA value for each desktop, or empty.
+Rectangle work_area;
+
+void SetCardinal(Atom atom, long value) {
+  XChangeProperty(x_display, x_root_window, atom, XA_CARDINAL, 32,
+                  PropModeReplace, reinterpret_cast<unsigned char*>(&value),
+                  1);
+}
+
+}  // namespace
+
+void InitRootProperties() {
+  Atom supported[] = {
+      xa::net_active_window,      xa::net_client_list,
+      xa::net_client_list_stacking, xa::net_current_desktop,
+      xa::net_number_of_desktops, xa::net_workarea,
+      xa::net_wm_pid,             xa::net_wm_strut,
+      xa::net_wm_strut_partial,   xa::net_wm_window_type};
+
+  XChangeProperty(x_display, x_root_window, xa::net_supported, XA_ATOM, 32,
+                  PropModeReplace, reinterpret_cast<unsigned char*>(supported),
+                  sizeof(supported) / sizeof(supported[0]));
+
+  client_list.replace = true;
+  client_list_stacking.replace = true;
+}
+
+void ClientListAdd(::Window x_window) {
+  client_list.Add(x_window);
+  client_list_stacking.Add(x_window);
+}
+
+void ClientListRaise(::Window x_window) {
+  auto& windows = client_list_stacking.windows;
+
+  if (!windows.empty() && windows.back() == x_window) return;
+
+  client_list_stacking.Remove(x_window);
+  client_list_stacking.Add(x_window);
+}
+
+void ClientListRemove(::Window x_window) {
+  client_list.Remove(x_window);
+  client_list_stacking.Remove(x_window);
+}
+
+void QueueProperty(::Window x_window, Atom property, Atom type,
+                   std::vector<long> values) {
+  auto& entry = queued_properties[std::make_pair(x_window, property)];
+  entry.type = type;
+  entry.values = std::move(values);
+}
+
+void QueueInputFocus(::Window x_window, Time time) {
+  queued_focus = x_window;
+  queued_focus_time = time;
+}
+
+void DropQueuedProperties(::Window x_window) {
+  queued_properties.erase(
+      queued_properties.lower_bound(std::make_pair(x_window, Atom(0))),
+      queued_properties.upper_bound(std::make_pair(x_window, ~Atom(0))));
+
+  // Focus must still leave whatever window had it, as it would have if the
+  // request had been sent before the window went away.
+  if (queued_focus == x_window) {
+    queued_focus = x_root_window;
+
+    auto active = queued_properties.find(
+        std::make_pair(x_root_window, xa::net_active_window));
+
+    if (active != queued_properties.end())
+      active->second.values.assign(1, x_root_window);
+  }
+}
+
+void FlushRootProperties() {
+  if (queued_focus != None) {
+    XSetInputFocus(x_display, queued_focus, RevertToParent, queued_focus_time);
+    queued_focus = None;
+  }
+
+  // The error handler may drop windows from the queue while we write.
+  auto properties = std::move(queued_properties);
+  queued_properties.clear();
+
+  for (auto& entry : properties) {
+    ::Window x_window = entry.first.first;
+    Atom atom = entry.first.second;
+    auto& property = entry.second;
+
+    if (x_window == x_root_window) {
+      auto written = root_properties.find(atom);
+
+      if (written != root_properties.end() && written->second == property)
+        continue;
+    }
+
+    XChangeProperty(x_display, x_window, atom, property.type, 32,
+                    PropModeReplace,
+                    reinterpret_cast<unsigned char*>(property.values.data()),
+                    property.values.size());
+
+    if (x_window == x_root_window) root_properties[atom] = std::move(property);
+  }
+
+  client_list.Flush();
+  client_list_stacking.Flush();
+
+  long desktop = current_session.ActiveScreen()->active_workspace;
+
+  if (desktop != current_desktop) {
+    SetCardinal(xa::net_current_desktop, desktop);
+    current_desktop = desktop;
+  }
+
+  const auto& session_work_area = current_session.WorkArea();
+
+  // One work area per desktop, all the same.
+  if (number_of_desktops != settings.workspace_count ||
+      !(work_area == session_work_area)) {
+    std::vector<long> values;
+
+    for (unsigned int i = 0; i < settings.workspace_count; ++i) {
+      values.insert(values.end(), {session_work_area.x, session_work_area.y,
+                                   session_work_area.width,
+                                   session_work_area.height});
+    }
+
+    XChangeProperty(x_display, x_root_window, xa::net_workarea, XA_CARDINAL,
+                    32, PropModeReplace,
+                    reinterpret_cast<unsigned char*>(values.data()),
+                    values.size());
+    work_area = session_work_area;
+  }
+
+  if (number_of_desktops != settings.workspace_count) {
+    SetCardinal(xa::net_number_of_desktops, settings.workspace_count);
+    number_of_desktops = settings.workspace_count;
+  }
+
+  // These are written after the event queue was drained, so nothing else
+  // sends them before the main loop goes to sleep.
+  XFlush(x_display);
+}
+
+}  // namespace cantera_wm
@@ -0,0 +1,47 @@
+#ifndef EWMH_H_
+#define EWMH_H_ 1
+
+#include <vector>
+
+#include <X11/Xlib.h>
+
+namespace cantera_wm {
+
+// Announces the EWMH root window properties we maintain in _NET_SUPPORTED,
+// and clears the client lists left behind by an earlier window manager.
+void InitRootProperties();
+
+// Record changes to the set of managed windows, i.e. those in a workspace
+// or ancillary to a screen, for _NET_CLIENT_LIST and
+// _NET_CLIENT_LIST_STACKING.  A new window is appended to both lists; a
+// raised one moves to the top of the stacking list.
+void ClientListAdd(::Window x_window);
+void ClientListRaise(::Window x_window);
+void ClientListRemove(::Window x_window);
+
+// Replaces the 32-bit `property` of `x_window` with `values` at the next
+// flush.  Only the last value queued for each window and property is
+// written, and a root window property not at all if it already holds it.
+void QueueProperty(::Window x_window, Atom property, Atom type,
+                   std::vector<long> values);
+
+// Gives `x_window` the input focus at the next flush.  Only the last
+// request before the flush is sent.
+void QueueInputFocus(::Window x_window, Time time);
+
+// Forgets what was queued for `x_window`, which has been destroyed.  Focus
+// queued for it goes to the root window instead.
+void DropQueuedProperties(::Window x_window);
+
+// Sends the queued input focus and property writes, and writes the root
+// properties that changed since the last call, once per property:
+// client list additions with PropModeAppend, and the whole list only after
+// a removal or restacking.  _NET_CURRENT_DESKTOP, _NET_NUMBER_OF_DESKTOPS and
+// _NET_WORKAREA are compared against the session instead of being tracked.
+// Called once per batch of events, after Session::UpdateWorkAreas(), and
+// flushes the connection so the writes need not wait for the next event.
+void FlushRootProperties();
+
+}  // namespace cantera_wm
+
+#endif  // !EWMH_H_
@@ -0,0 +1,201 @@
+#include "font.h"
+
+#include <vector>
+
+#include <fontconfig/fontconfig.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "cantera-wm.h"
+#include "log.h"
+
+namespace cantera_wm {
+
+namespace {
+
+FT_Library ft_library;
+
+// Decodes the next UTF-8 sequence of `text` starting at `*i`, advancing
+// `*i` past it.  Malformed input yields U+FFFD.
+unsigned int NextCodePoint(const std::string& text, size_t* i) {
+  auto byte = [&text](size_t j) -> unsigned int {
+    return static_cast<unsigned char>(text[j]);
+  };
+
+  unsigned int ch = byte((*i)++);
+  unsigned int length, result;
+
+  if (ch < 0x80) return ch;
+
+  if ((ch & 0xe0) == 0xc0) {
+    length = 1;
+    result = ch & 0x1f;
+  } else if ((ch & 0xf0) == 0xe0) {
+    length = 2;
+    result = ch & 0x0f;
+  } else if ((ch & 0xf8) == 0xf0) {
+    length = 3;
+    result = ch & 0x07;
+  } else {
+    return 0xfffd;
+  }
+
+  for (; length; --length) {
+    if (*i == text.size() || (byte(*i) & 0xc0) != 0x80) return 0xfffd;
+
+    result = (result << 6) | (byte((*i)++) & 0x3f);
+  }
+
+  return result;
+}
+
+}  // namespace
+
+std::unique_ptr<Font> Font::Open(const char* pattern) {
+  if (!ft_library && FT_Init_FreeType(&ft_library)) {
+    LOG(kWarning, "Failed to initialize FreeType");
+    return nullptr;
+  }
+
+  FcPattern* fc_pattern =
+      FcNameParse(reinterpret_cast<const FcChar8*>(pattern));
+
+  if (!fc_pattern) {
+    LOG(kWarning, "Invalid font pattern '%s'", pattern);
+    return nullptr;
+  }
+
+  FcConfigSubstitute(nullptr, fc_pattern, FcMatchPattern);
+  FcDefaultSubstitute(fc_pattern);
+
+  FcResult fc_result;
+  FcPattern* match = FcFontMatch(nullptr, fc_pattern, &fc_result);
+  FcPatternDestroy(fc_pattern);
+
+  FcChar8* path;
+  int index = 0;
+  double pixel_size = 12.0;
+
+  if (!match || FcPatternGetString(match, FC_FILE, 0, &path) != FcResultMatch) {
+    LOG(kWarning, "No font matches '%s'", pattern);
+    if (match) FcPatternDestroy(match);
+    return nullptr;
+  }
+
+  FcPatternGetInteger(match, FC_INDEX, 0, &index);
+  FcPatternGetDouble(match, FC_PIXEL_SIZE, 0, &pixel_size);
+
+  std::unique_ptr<Font> result(new Font);
+
+  if (FT_New_Face(ft_library, reinterpret_cast<const char*>(path), index,
+                  &result->face_)) {
+    LOG(kWarning, "Failed to load font '%s'", path);
+    FcPatternDestroy(match);
+    return nullptr;
+  }
+
+  FcPatternDestroy(match);
+
+  FT_Set_Pixel_Sizes(result->face_, 0, static_cast<FT_UInt>(pixel_size + 0.5));
+
+  result->ascent_ = result->face_->size->metrics.ascender >> 6;
+  result->descent_ = -(result->face_->size->metrics.descender >> 6);
+
+  result->glyph_set_ = XRenderCreateGlyphSet(
+      x_display, XRenderFindStandardFormat(x_display, PictStandardA8));
+
+  return result;
+}
+
+Font::~Font() {
+  for (const auto& solid : solid_pictures_)
+    XRenderFreePicture(x_display, solid.second);
+
+  if (glyph_set_) XRenderFreeGlyphSet(x_display, glyph_set_);
+
+  if (face_) FT_Done_Face(face_);
+}
+
+int Font::LoadGlyph(unsigned int code_point) {
+  auto i = advances_.find(code_point);
+
+  if (i != advances_.end()) return i->second;
+
+  XGlyphInfo info = {};
+  std::vector<char> pixels;
+
+  if (!FT_Load_Char(face_, code_point, FT_LOAD_RENDER)) {
+    const FT_Bitmap& bitmap = face_->glyph->bitmap;
+
+    info.width = bitmap.width;
+    info.height = bitmap.rows;
+    info.x = -face_->glyph->bitmap_left;
+    info.y = face_->glyph->bitmap_top;
+    info.xOff = face_->glyph->advance.x >> 6;
+
+    // XRender wants A8 rows padded to 4 bytes.
+    unsigned int stride = (bitmap.width + 3) & ~3;
+
+    pixels.resize(stride * bitmap.rows);
+
+    for (unsigned int y = 0; y < bitmap.rows; ++y) {
+      for (unsigned int x = 0; x < bitmap.width; ++x)
+        pixels[y * stride + x] = bitmap.buffer[y * bitmap.pitch + x];
+    }
+  }
+
+  Glyph glyph = code_point;
+
+  XRenderAddGlyphs(x_display, glyph_set_, &glyph, &info, 1, pixels.data(),
+                   pixels.size());
+
+  advances_[code_point] = info.xOff;
+
+  return info.xOff;
+}
+
+Picture Font::SolidPicture(const XRenderColor& color) {
+  unsigned long long key = color.red;
+  key = (key << 16) | color.green;
+  key = (key << 16) | color.blue;
+  key = (key << 16) | color.alpha;
+
+  auto& picture = solid_pictures_[key];
+
+  if (!picture) picture = XRenderCreateSolidFill(x_display, &color);
+
+  return picture;
+}
+
+void Font::Draw(Picture destination, int x, int y, const XRenderColor& color,
+                const std::string& text, unsigned int max_width) {
+  std::vector<unsigned int> glyphs;
+  unsigned int width = 0;
+
+  for (size_t i = 0; i < text.size();) {
+    unsigned int code_point = NextCodePoint(text, &i);
+    int advance = LoadGlyph(code_point);
+
+    if (max_width && width + advance > max_width) break;
+
+    width += advance;
+    glyphs.push_back(code_point);
+  }
+
+  if (glyphs.empty()) return;
+
+  XRenderCompositeString32(x_display, PictOpOver, SolidPicture(color),
+                           destination, nullptr, glyph_set_, 0, 0, x, y,
+                           glyphs.data(), glyphs.size());
+}
+
+unsigned int Font::Width(const std::string& text) {
+  unsigned int width = 0;
+
+  for (size_t i = 0; i < text.size();)
+    width += LoadGlyph(NextCodePoint(text, &i));
+
+  return width;
+}
+
+}  // namespace cantera_wm
@@ -0,0 +1,66 @@
+#ifndef FONT_H_
+#define FONT_H_ 1
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrender.h>
+
+// FreeType's face record, declared here without the FreeType headers.
+struct FT_FaceRec_;
+
+namespace cantera_wm {
+
+// A font rasterized with FreeType into an XRender glyph set.  Each glyph is
+// rasterized and uploaded to the X server the first time it is drawn, so
+// drawing text only sends the glyph indexes.
+class Font {
+ public:
+  // Opens the font best matching the fontconfig `pattern`, e.g.
+  // "sans-serif:pixelsize=12".  Returns null on failure, after logging why.
+  static std::unique_ptr<Font> Open(const char* pattern);
+
+  ~Font();
+
+  Font(const Font& rhs) = delete;
+  Font& operator=(const Font& rhs) = delete;
+
+  // Draws the UTF-8 string `text` onto `destination` in `color`, with the
+  // baseline starting at (`x`, `y`).  Stops at the first character that
+  // would end beyond `max_width` pixels, if given.
+  void Draw(Picture destination, int x, int y, const XRenderColor& color,
+            const std::string& text, unsigned int max_width = 0);
+
+  // Returns the horizontal advance of `text`.
+  unsigned int Width(const std::string& text);
+
+  int Ascent() const { return ascent_; }
+  int Descent() const { return descent_; }
+
+ private:
+  Font() = default;
+
+  // Uploads `code_point` to the glyph set unless it is there already, and
+  // returns its horizontal advance.
+  int LoadGlyph(unsigned int code_point);
+
+  // Returns a solid picture of `color`, created on first use.
+  Picture SolidPicture(const XRenderColor& color);
+
+  ::FT_FaceRec_* face_ = nullptr;
+
+  GlyphSet glyph_set_ = 0;
+
+  int ascent_ = 0, descent_ = 0;
+
+  // Advance of every uploaded glyph, keyed by code point.
+  std::unordered_map<unsigned int, int> advances_;
+
+  std::unordered_map<unsigned long long, Picture> solid_pictures_;
+};
+
+}  // namespace cantera_wm
+
+#endif  // !FONT_H_
@@ -0,0 +1,141 @@
+/* Compares two frames written by `cantera-wm --frame-dump`.  Exits with 0
+ * if they match within the tolerance, 1 if they differ and 2 on trouble,
+ * like cmp(1).  */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <err.h>
+
+struct image {
+  unsigned int width, height;
+  unsigned char *pixels;
+};
+
+static void read_ppm(const char *path, struct image *result) {
+  FILE *input;
+  unsigned int maxval;
+  size_t size;
+
+  if (!(input = fopen(path, "r"))) err(2, "Failed to open '%s'", path);
+
+  if (3 != fscanf(input, "P6 %u %u %u", &result->width, &result->height,
+                  &maxval) ||
+      maxval != 255 || fgetc(input) == EOF)
+    errx(2, "%s: not an 8-bit binary PPM file", path);
+
+  size = (size_t)result->width * result->height * 3;
+
+  if (!(result->pixels = malloc(size)))
+    err(2, "Failed to allocate %zu bytes for '%s'", size, path);
+
+  if (size != fread(result->pixels, 1, size, input))
+    errx(2, "%s: file is truncated", path);
+
+  fclose(input);
+}
+
+static void write_ppm(const char *path, const struct image *image) {
+  FILE *output;
+
+  if (!(output = fopen(path, "w"))) err(2, "Failed to open '%s'", path);
+
+  fprintf(output, "P6\n%u %u\n255\n", image->width, image->height);
+  fwrite(image->pixels, 1, (size_t)image->width * image->height * 3, output);
+
+  if (ferror(output) || fclose(output)) errx(2, "%s: write error", path);
+}
+
+int main(int argc, char **argv) {
+  struct image expected, actual, diff;
+  const char *diff_path = NULL;
+  unsigned int tolerance = 0;
+  unsigned int x, y, min_x, min_y, max_x, max_y;
+  size_t differing = 0;
+  int i;
+
+  while ((i = getopt(argc, argv, "o:t:")) != -1) {
+    switch (i) {
+      case 'o':
+        diff_path = optarg;
+        break;
+
+      case 't':
+        tolerance = strtoul(optarg, NULL, 0);
+        break;
+
+      default:
+        fprintf(stderr,
+                "Usage: %s [-t TOLERANCE] [-o DIFF.ppm] EXPECTED.ppm "
+                "ACTUAL.ppm\n",
+                argv[0]);
+
+        return 2;
+    }
+  }
+
+  if (optind + 2 != argc)
+    errx(2, "Usage: %s [-t TOLERANCE] [-o DIFF.ppm] EXPECTED.ppm ACTUAL.ppm",
+         argv[0]);
+
+  read_ppm(argv[optind], &expected);
+  read_ppm(argv[optind + 1], &actual);
+
+  if (expected.width != actual.width || expected.height != actual.height) {
+    printf("Size differs: %ux%u vs. %ux%u\n", expected.width, expected.height,
+           actual.width, actual.height);
+
+    return 1;
+  }
+
+  /* Matching pixels are dimmed in the diff image, and differing ones shown
+   * in red.  */
+  diff = actual;
+
+  if (!(diff.pixels = malloc((size_t)diff.width * diff.height * 3)))
+    err(2, "malloc failed");
+
+  min_x = actual.width;
+  min_y = actual.height;
+  max_x = max_y = 0;
+
+  for (y = 0; y < actual.height; ++y) {
+    for (x = 0; x < actual.width; ++x) {
+      size_t offset = ((size_t)y * actual.width + x) * 3;
+      int different = 0;
+
+      for (i = 0; i < 3; ++i) {
+        if (abs(expected.pixels[offset + i] - actual.pixels[offset + i]) >
+            (int)tolerance)
+          different = 1;
+      }
+
+      if (different) {
+        diff.pixels[offset] = 0xff;
+        diff.pixels[offset + 1] = 0;
+        diff.pixels[offset + 2] = 0;
+
+        if (x < min_x) min_x = x;
+        if (y < min_y) min_y = y;
+        if (x > max_x) max_x = x;
+        if (y > max_y) max_y = y;
+
+        ++differing;
+      } else {
+        for (i = 0; i < 3; ++i)
+          diff.pixels[offset + i] = actual.pixels[offset + i] / 4;
+      }
+    }
+  }
+
+  if (diff_path) write_ppm(diff_path, &diff);
+
+  if (!differing) return 0;
+
+  printf("%zu pixels differ, within %ux%u+%u+%u\n", differing,
+         max_x - min_x + 1, max_y - min_y + 1, min_x, min_y);
+
+  return 1;
+}
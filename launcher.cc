@@ -0,0 +1,545 @@
+#include "launcher.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "event-loop.h"
+#include "log.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+namespace cantera_wm {
+
+namespace {
+
+// Commands longer than this are rejected by the helper.
+const size_t kMaxCommandLength = 16384;
+
+// Number of exited children whose records are kept.
+const size_t kMaxExitedChildren = 32;
+
+struct LaunchRequest {
+  uint32_t cookie;
+  uint32_t screen_index;
+  // Followed by the command, without a terminating NUL.
+};
+
+struct LaunchReply {
+  uint32_t cookie;
+  int32_t pid;
+  int32_t error;
+};
+
+struct PendingLaunch {
+  std::string command;
+  timespec start;
+  size_t screen_index;
+  unsigned int workspace_index;
+  std::function<void(pid_t pid)> callback;
+};
+
+int launcher_fd = -1;
+pid_t helper_pid = -1;
+uint32_t next_cookie;
+std::map<uint32_t, PendingLaunch> pending_launches;
+
+std::map<pid_t, ChildProcess> children;
+
+// Exited children, oldest first.
+std::deque<pid_t> exited_children;
+
+// Number of running children without a pidfd.
+size_t unwatched_children;
+
+// Whether waitid() accepts P_PIDFD, which came one release after
+// pidfd_open().  Without it, pidfds are not used at all.
+bool PidfdWaitSupported() {
+  static const bool supported = [] {
+    siginfo_t info;
+
+    // A kernel that knows P_PIDFD rejects the descriptor instead.
+    return !(-1 == waitid(static_cast<idtype_t>(P_PIDFD), -1, &info,
+                          WEXITED | WNOHANG) &&
+             errno == EINVAL);
+  }();
+
+  return supported;
+}
+
+double MillisecondsSince(const timespec& start) {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (now.tv_sec - start.tv_sec) * 1e3 +
+         (now.tv_nsec - start.tv_nsec) * 1e-6;
+}
+
+void ChildExited(pid_t pid, int status) {
+  auto i = children.find(pid);
+  if (i == children.end() || i->second.exited) return;
+
+  auto& child = i->second;
+
+  if (WIFEXITED(status))
+    LOG(kInfo, "Process %d ('%s') exited with status %d after %.3f s",
+        static_cast<int>(pid), child.command.c_str(), WEXITSTATUS(status),
+        MillisecondsSince(child.launch_time) * 1e-3);
+  else if (WIFSIGNALED(status))
+    LOG(kInfo, "Process %d ('%s') was killed by signal %d after %.3f s",
+        static_cast<int>(pid), child.command.c_str(), WTERMSIG(status),
+        MillisecondsSince(child.launch_time) * 1e-3);
+
+  if (child.pidfd != -1) {
+    UnwatchFd(child.pidfd);
+    close(child.pidfd);
+    child.pidfd = -1;
+  } else {
+    --unwatched_children;
+  }
+
+  child.exited = true;
+  child.exit_status = status;
+
+  exited_children.push_back(pid);
+
+  if (exited_children.size() > kMaxExitedChildren) {
+    auto j = children.find(exited_children.front());
+
+    // The pid may have been reused by a child that is still running.
+    if (j != children.end() && j->second.exited) children.erase(j);
+
+    exited_children.pop_front();
+  }
+}
+
+void ProcessChildExit(pid_t pid, int pidfd) {
+  siginfo_t info;
+
+  memset(&info, 0, sizeof(info));
+
+  if (-1 == waitid(static_cast<idtype_t>(P_PIDFD), pidfd, &info,
+                   WEXITED | WNOHANG)) {
+    int status;
+    pid_t ret = waitpid(pid, &status, WNOHANG);
+
+    if (ret == pid) {
+      ChildExited(pid, status);
+    } else if (ret == -1) {
+      // Leave the child to ReapChildren(), rather than waking up for a
+      // readable pidfd that we cannot consume.
+      auto i = children.find(pid);
+
+      UnwatchFd(pidfd);
+      close(pidfd);
+
+      if (i != children.end()) {
+        i->second.pidfd = -1;
+        ++unwatched_children;
+      }
+    }
+
+    return;
+  }
+
+  // The pidfd may also become readable for reasons other than exit.
+  if (!info.si_pid) return;
+
+  int status;
+
+  if (info.si_code == CLD_EXITED)
+    status = W_EXITCODE(info.si_status, 0);
+  else
+    status = info.si_status | (info.si_code == CLD_DUMPED ? WCOREFLAG : 0);
+
+  ChildExited(pid, status);
+}
+
+// Starts tracking `pid`, which must be a child of ours that has not been
+// reaped yet.
+ChildProcess* TrackChild(pid_t pid, const std::string& command,
+                         const timespec& launch_time) {
+  auto& child = children[pid];
+
+  // Replaces the record of an exited process that had the same pid.
+  child = ChildProcess();
+  child.pid = pid;
+  child.command = command;
+  child.launch_time = launch_time;
+
+  if (PidfdWaitSupported()) child.pidfd = syscall(SYS_pidfd_open, pid, 0);
+
+  if (child.pidfd == -1) {
+    ++unwatched_children;
+  } else {
+    WatchFd(child.pidfd, [pid, pidfd = child.pidfd] {
+      ProcessChildExit(pid, pidfd);
+    });
+  }
+
+  return &child;
+}
+
+// Returns true if `command` uses shell syntax, as opposed to being a plain
+// list of words that can be passed directly to execvp().
+bool NeedsShell(const char* command) {
+  return nullptr != strpbrk(command, "\"'\\$`*?[]{}~;&|<>()#=\n");
+}
+
+// Fills `args` with the argument vector for `command`, pointing into
+// `storage`.  Returns false if there is nothing to run.
+bool BuildArgs(const char* command, std::vector<std::string>* storage,
+               std::vector<char*>* args) {
+  if (NeedsShell(command)) {
+    storage->emplace_back("exec ");
+    storage->back() += command;
+
+    args->push_back(const_cast<char*>("/bin/sh"));
+    args->push_back(const_cast<char*>("-c"));
+    args->push_back(&storage->back()[0]);
+  } else {
+    const char* c = command;
+
+    for (;;) {
+      c += strspn(c, " \t");
+      if (!*c) break;
+
+      size_t length = strcspn(c, " \t");
+      storage->emplace_back(c, length);
+      c += length;
+    }
+
+    if (storage->empty()) return false;
+
+    for (auto& word : *storage) args->push_back(&word[0]);
+  }
+
+  args->push_back(nullptr);
+
+  return true;
+}
+
+// Starts `command` from within the window manager process.  Used when the
+// helper is unavailable.
+pid_t SpawnDirectly(const char* command, const PendingLaunch& launch) {
+  std::vector<std::string> storage;
+  std::vector<char*> args;
+  posix_spawnattr_t attr;
+  char buf[32];
+  pid_t pid;
+  int ret;
+
+  if (!BuildArgs(command, &storage, &args)) return -1;
+
+  sprintf(buf, "%zu", launch.screen_index);
+  setenv("CURRENT_SCREEN", buf, 1);
+
+  // posix_spawn() uses vfork() semantics, so unlike fork() it doesn't copy
+  // our page tables, and it can still call setsid() in the child.
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+
+  ret = posix_spawnp(&pid, args[0], nullptr, &attr, args.data(), environ);
+
+  posix_spawnattr_destroy(&attr);
+
+  if (ret) {
+    LOG(kWarning, "Failed to launch '%s': %s", command, strerror(ret));
+
+    return -1;
+  }
+
+  auto child = TrackChild(pid, command, launch.start);
+  child->screen_index = launch.screen_index;
+  child->workspace_index = launch.workspace_index;
+
+  return pid;
+}
+
+/*** Helper process ***/
+
+struct CloneArgs {
+  char* const* args;
+  int error;
+};
+
+int ExecChild(void* arg) {
+  auto clone_args = reinterpret_cast<CloneArgs*>(arg);
+
+  setsid();
+
+  execvp(clone_args->args[0], clone_args->args);
+
+  // We share memory with the helper until we exit.
+  clone_args->error = errno;
+
+  _exit(EXIT_FAILURE);
+}
+
+// Starts `command` as a child of the window manager rather than of the
+// helper, so that the window manager can wait for it.  On failure, returns
+// -1 and sets `*error`.  If the program could not be executed, the pid of
+// the exited child is still returned so that it can be reaped.
+pid_t HelperSpawn(const char* command, int* error) {
+  alignas(16) static char stack[64 * 1024];
+  std::vector<std::string> storage;
+  std::vector<char*> args;
+  CloneArgs clone_args;
+  pid_t pid;
+
+  *error = 0;
+
+  if (!BuildArgs(command, &storage, &args)) {
+    *error = EINVAL;
+    return -1;
+  }
+
+  clone_args.args = args.data();
+  clone_args.error = 0;
+
+  // CLONE_VFORK suspends us until the child has called execve() or exited,
+  // so the child can safely borrow our memory and stack.
+  pid = clone(ExecChild, stack + sizeof(stack),
+              CLONE_VM | CLONE_VFORK | CLONE_PARENT | SIGCHLD, &clone_args);
+
+  if (pid == -1)
+    *error = errno;
+  else
+    *error = clone_args.error;
+
+  return pid;
+}
+
+[[noreturn]] void HelperMain(int fd) {
+  std::vector<char> buffer(sizeof(LaunchRequest) + kMaxCommandLength + 1);
+
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+  for (;;) {
+    LaunchRequest request;
+    LaunchReply reply;
+    ssize_t ret;
+    char buf[32];
+
+    if (-1 == (ret = recv(fd, buffer.data(), buffer.size() - 1, 0))) {
+      if (errno == EINTR) continue;
+
+      _exit(EXIT_FAILURE);
+    }
+
+    // The window manager has exited.
+    if (!ret) _exit(EXIT_SUCCESS);
+
+    if (static_cast<size_t>(ret) < sizeof(request)) continue;
+
+    memcpy(&request, buffer.data(), sizeof(request));
+    buffer[ret] = 0;
+
+    sprintf(buf, "%u", request.screen_index);
+    setenv("CURRENT_SCREEN", buf, 1);
+
+    reply.cookie = request.cookie;
+    reply.pid = HelperSpawn(buffer.data() + sizeof(request), &reply.error);
+
+    send(fd, &reply, sizeof(reply), MSG_NOSIGNAL);
+  }
+}
+
+/*** Window manager side ***/
+
+void FinishLaunch(uint32_t cookie, pid_t pid, int error) {
+  auto i = pending_launches.find(cookie);
+  if (i == pending_launches.end()) return;
+
+  auto launch = std::move(i->second);
+  pending_launches.erase(i);
+
+  if (pid > 0) {
+    auto child = TrackChild(pid, launch.command, launch.start);
+    child->screen_index = launch.screen_index;
+    child->workspace_index = launch.workspace_index;
+  }
+
+  if (error) {
+    LOG(kWarning, "Failed to launch '%s': %s", launch.command.c_str(),
+        strerror(error));
+    pid = -1;
+  } else {
+    LOG(kInfo, "Launched '%s' as pid %d in %.3f ms", launch.command.c_str(),
+        static_cast<int>(pid), MillisecondsSince(launch.start));
+  }
+
+  if (launch.callback) launch.callback(pid);
+}
+
+void StopLauncher() {
+  UnwatchFd(launcher_fd);
+  close(launcher_fd);
+  launcher_fd = -1;
+
+  LOG(kWarning, "Launcher helper exited; launching programs directly");
+
+  // We don't know whether these were started.
+  while (!pending_launches.empty())
+    FinishLaunch(pending_launches.begin()->first, -1, EPIPE);
+}
+
+void ProcessLauncherReplies() {
+  for (;;) {
+    LaunchReply reply;
+    ssize_t ret;
+
+    ret = recv(launcher_fd, &reply, sizeof(reply), MSG_DONTWAIT);
+
+    if (ret == -1) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+    }
+
+    if (ret <= 0) {
+      StopLauncher();
+      return;
+    }
+
+    if (ret != sizeof(reply)) continue;
+
+    FinishLaunch(reply.cookie, reply.pid, reply.error);
+  }
+}
+
+}  // namespace
+
+void StartLauncher() {
+  int fds[2];
+  pid_t pid;
+
+  if (-1 == socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds)) {
+    LOG(kError, "Failed to create launcher socket: %s", strerror(errno));
+    return;
+  }
+
+  if (-1 == (pid = fork())) {
+    LOG(kError, "Failed to start launcher helper: %s", strerror(errno));
+    close(fds[0]);
+    close(fds[1]);
+    return;
+  }
+
+  if (!pid) {
+    close(fds[0]);
+    HelperMain(fds[1]);
+  }
+
+  close(fds[1]);
+
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  TrackChild(pid, "launcher helper", now);
+
+  helper_pid = pid;
+  launcher_fd = fds[0];
+  WatchFd(launcher_fd, ProcessLauncherReplies);
+}
+
+void ShutDownLauncher() {
+  if (launcher_fd == -1) return;
+
+  UnwatchFd(launcher_fd);
+  close(launcher_fd);
+  launcher_fd = -1;
+
+  while (!pending_launches.empty())
+    FinishLaunch(pending_launches.begin()->first, -1, EPIPE);
+
+  // The helper exits as soon as it sees the socket close.
+  int status;
+
+  if (helper_pid == waitpid(helper_pid, &status, 0))
+    ChildExited(helper_pid, status);
+
+  helper_pid = -1;
+}
+
+ChildProcess* RestoreChild(pid_t pid, const std::string& command,
+                           const timespec& launch_time) {
+  return TrackChild(pid, command, launch_time);
+}
+
+void LaunchProgram(const char* command, size_t screen_index,
+                   unsigned int workspace_index,
+                   std::function<void(pid_t pid)> callback) {
+  PendingLaunch launch;
+  uint32_t cookie;
+
+  clock_gettime(CLOCK_MONOTONIC, &launch.start);
+  launch.command = command;
+  launch.screen_index = screen_index;
+  launch.workspace_index = workspace_index;
+  launch.callback = std::move(callback);
+
+  if (launcher_fd != -1 && launch.command.size() <= kMaxCommandLength) {
+    LaunchRequest request;
+    std::string message;
+
+    cookie = next_cookie++;
+
+    request.cookie = cookie;
+    request.screen_index = screen_index;
+
+    message.assign(reinterpret_cast<const char*>(&request), sizeof(request));
+    message += launch.command;
+
+    if (-1 != send(launcher_fd, message.data(), message.size(),
+                   MSG_DONTWAIT | MSG_NOSIGNAL)) {
+      pending_launches.emplace(cookie, std::move(launch));
+      return;
+    }
+
+    LOG(kError, "Failed to send command to launcher helper: %s",
+        strerror(errno));
+  }
+
+  pid_t pid = SpawnDirectly(command, launch);
+
+  if (pid != -1)
+    LOG(kInfo, "Launched '%s' as pid %d in %.3f ms", command,
+        static_cast<int>(pid), MillisecondsSince(launch.start));
+
+  if (launch.callback) launch.callback(pid);
+}
+
+const std::map<pid_t, ChildProcess>& Children() { return children; }
+
+ChildProcess* FindChild(pid_t pid) {
+  auto i = children.find(pid);
+
+  return (i != children.end() && !i->second.exited) ? &i->second : nullptr;
+}
+
+void ReapChildren() {
+  int status;
+  pid_t child;
+
+  while (unwatched_children && (0 < (child = waitpid(-1, &status, WNOHANG))))
+    ChildExited(child, status);
+}
+
+}  // namespace cantera_wm
@@ -0,0 +1,74 @@
+#ifndef LAUNCHER_H_
+#define LAUNCHER_H_ 1
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <time.h>
+
+namespace cantera_wm {
+
+// A program started by LaunchProgram().  The record outlives the process
+// for a while, so that how it ended can still be looked up.
+struct ChildProcess {
+  pid_t pid = -1;
+
+  // Becomes readable when the process exits.  -1 if the kernel does not
+  // support pidfds, in which case ReapChildren() has to poll.
+  int pidfd = -1;
+
+  std::string command;
+  timespec launch_time;
+
+  // The screen and workspace that were active when the program was
+  // launched.  Its first window is placed there.
+  size_t screen_index = 0;
+  unsigned int workspace_index = 0;
+
+  // Windows that have been mapped with this process in _NET_WM_PID.
+  std::vector<unsigned long> windows;
+
+  // Set once the process has been reaped, along with its wait() status.
+  bool exited = false;
+  int exit_status = 0;
+};
+
+// Forks the helper process that starts programs on our behalf.  Call this
+// before connecting to X, so that the helper stays small and does not
+// share our X connection.
+void StartLauncher();
+
+// Closes the connection to the helper and waits for it to exit, e.g. before
+// exec().  Programs are started directly afterwards.
+void ShutDownLauncher();
+
+// Resumes tracking `pid`, a child started before this process image was
+// exec()ed.
+ChildProcess* RestoreChild(pid_t pid, const std::string& command,
+                           const timespec& launch_time);
+
+// Starts `command` with CURRENT_SCREEN set to `screen_index`, without
+// blocking the event loop.  `callback`, if set, receives the pid of the new
+// process from the main loop once it is known, or -1 on failure.
+void LaunchProgram(const char* command, size_t screen_index,
+                   unsigned int workspace_index,
+                   std::function<void(pid_t pid)> callback = nullptr);
+
+// Child processes by pid: those still running, and the most recently
+// exited ones.
+const std::map<pid_t, ChildProcess>& Children();
+
+// Returns the record for the running child `pid`, or NULL.
+ChildProcess* FindChild(pid_t pid);
+
+// Reaps exited children that could not be given a pidfd.  Children with a
+// pidfd are reaped from the event loop as soon as they exit.
+void ReapChildren();
+
+}  // namespace cantera_wm
+
+#endif  // !LAUNCHER_H_
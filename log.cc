@@ -0,0 +1,226 @@
+#include "log.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+#include <semaphore.h>
+#include <unistd.h>
+
+namespace cantera_wm {
+
+std::atomic<LogLevel> log_level{LogLevel::kInfo};
+
+namespace {
+
+// Messages each call site may log per second.
+const unsigned int kLogBurst = 10;
+
+const size_t kRingSize = 1024;
+const size_t kMessageSize = 256;
+
+// One message in the ring.  `sequence` tells producers and the consumer
+// whose turn it is, as in Dmitry Vyukov's bounded queue: it equals the
+// position when the slot is free for the producer claiming that position,
+// and the position plus one when it holds that position's message.
+struct Slot {
+  std::atomic<size_t> sequence;
+  size_t length;
+  char text[kMessageSize];
+};
+
+Slot ring[kRingSize];
+
+// Next position for producers to claim.
+std::atomic<size_t> ring_head;
+
+// Next position to write out.  Protected by drain_mutex.
+size_t ring_tail;
+std::mutex drain_mutex;
+
+// Messages lost because the ring was full.
+std::atomic<unsigned long> dropped;
+
+sem_t pending;
+std::atomic<bool> thread_started;
+
+unsigned long long CoarseNowMs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+  return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+void WriteAll(const char* data, size_t length) {
+  while (length) {
+    ssize_t ret = write(STDERR_FILENO, data, length);
+
+    if (ret <= 0) return;
+
+    data += ret;
+    length -= ret;
+  }
+}
+
+// Formats a message, with its newline, into `buffer`.  Returns the length.
+size_t Format(char* buffer, size_t size, unsigned int suppressed,
+              const char* format, va_list args) {
+  int length = vsnprintf(buffer, size - 1, format, args);
+
+  if (length < 0) length = 0;
+  if (static_cast<size_t>(length) >= size - 1) length = size - 2;
+
+  if (suppressed) {
+    int extra = snprintf(buffer + length, size - 1 - length,
+                         " (%u similar messages suppressed)", suppressed);
+
+    if (extra > 0) length = std::min<size_t>(length + extra, size - 2);
+  }
+
+  buffer[length++] = '\n';
+
+  return length;
+}
+
+void Drain() {
+  std::lock_guard<std::mutex> lock(drain_mutex);
+
+  char buffer[16 * 1024];
+  size_t used = 0;
+
+  for (;;) {
+    Slot& slot = ring[ring_tail % kRingSize];
+
+    if (slot.sequence.load(std::memory_order_acquire) != ring_tail + 1) break;
+
+    if (used + slot.length > sizeof(buffer)) {
+      WriteAll(buffer, used);
+      used = 0;
+    }
+
+    memcpy(buffer + used, slot.text, slot.length);
+    used += slot.length;
+
+    slot.sequence.store(ring_tail + kRingSize, std::memory_order_release);
+    ++ring_tail;
+  }
+
+  if (unsigned long count = dropped.exchange(0, std::memory_order_relaxed)) {
+    char note[64];
+    int length = snprintf(note, sizeof(note), "%lu log messages dropped\n",
+                          count);
+
+    if (used + length > sizeof(buffer)) {
+      WriteAll(buffer, used);
+      used = 0;
+    }
+
+    memcpy(buffer + used, note, length);
+    used += length;
+  }
+
+  WriteAll(buffer, used);
+}
+
+void LogThread() {
+  for (;;) {
+    while (sem_wait(&pending) == -1) {
+    }
+
+    Drain();
+  }
+}
+
+}  // namespace
+
+bool LogSite::Allow(unsigned int* suppressed_count) {
+  unsigned long long now = CoarseNowMs();
+
+  if (now - window_start_ms.load(std::memory_order_relaxed) >= 1000) {
+    window_start_ms.store(now, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+  }
+
+  if (count.fetch_add(1, std::memory_order_relaxed) >= kLogBurst) {
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  *suppressed_count = suppressed.exchange(0, std::memory_order_relaxed);
+
+  return true;
+}
+
+void LogMessage(unsigned int suppressed, const char* format, ...) {
+  va_list args;
+
+  if (!thread_started.load(std::memory_order_acquire)) {
+    char buffer[kMessageSize];
+
+    va_start(args, format);
+    size_t length = Format(buffer, sizeof(buffer), suppressed, format, args);
+    va_end(args);
+
+    WriteAll(buffer, length);
+
+    return;
+  }
+
+  size_t position = ring_head.load(std::memory_order_relaxed);
+  Slot* slot;
+
+  for (;;) {
+    slot = &ring[position % kRingSize];
+
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    auto difference = static_cast<ptrdiff_t>(sequence - position);
+
+    if (!difference) {
+      if (ring_head.compare_exchange_weak(position, position + 1,
+                                          std::memory_order_relaxed))
+        break;
+    } else if (difference < 0) {
+      // Full.  Never wait for the logging thread.
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      position = ring_head.load(std::memory_order_relaxed);
+    }
+  }
+
+  va_start(args, format);
+  slot->length = Format(slot->text, sizeof(slot->text), suppressed, format,
+                        args);
+  va_end(args);
+
+  slot->sequence.store(position + 1, std::memory_order_release);
+
+  sem_post(&pending);
+}
+
+void StartLogThread() {
+  if (thread_started.load()) return;
+
+  for (size_t i = 0; i < kRingSize; ++i)
+    ring[i].sequence.store(i, std::memory_order_relaxed);
+
+  sem_init(&pending, 0, 0);
+
+  std::thread(LogThread).detach();
+
+  atexit(FlushLog);
+
+  thread_started.store(true, std::memory_order_release);
+}
+
+void FlushLog() {
+  if (thread_started.load(std::memory_order_acquire)) Drain();
+}
+
+}  // namespace cantera_wm
@@ -0,0 +1,54 @@
+#ifndef LOG_H_
+#define LOG_H_ 1
+
+#include <atomic>
+
+namespace cantera_wm {
+
+enum class LogLevel { kDebug, kInfo, kWarning, kError };
+
+// Messages below this level are discarded at the call site, before their
+// arguments are evaluated.
+extern std::atomic<LogLevel> log_level;
+
+// Rate limiting state of one LOG() call site.  Constant-initialized, so the
+// static instance in LOG() needs no guard.
+struct LogSite {
+  // Returns true if the call site may log now, and sets `*suppressed` to the
+  // number of messages dropped by the rate limit since it last could.
+  bool Allow(unsigned int* suppressed);
+
+  std::atomic<unsigned long long> window_start_ms{0};
+  std::atomic<unsigned int> count{0};
+  std::atomic<unsigned int> suppressed{0};
+};
+
+// Formats a message and queues it for the logging thread.  Use LOG()
+// instead.
+void LogMessage(unsigned int suppressed, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Starts the thread that writes queued messages to stderr.  Until then, and
+// in processes forked before, messages are written directly.
+void StartLogThread();
+
+// Writes all queued messages.  Also called at exit.
+void FlushLog();
+
+}  // namespace cantera_wm
+
+// Logs a printf-style message, without a trailing newline, at level `level`
+// (kDebug, kInfo, kWarning or kError).  Each call site logs at most a few
+// messages per second; the rest are counted and reported with the next one.
+#define LOG(level, ...)                                                       \
+  do {                                                                        \
+    if (::cantera_wm::LogLevel::level >=                                      \
+        ::cantera_wm::log_level.load(std::memory_order_relaxed)) {            \
+      static ::cantera_wm::LogSite log_site;                                  \
+      unsigned int log_suppressed;                                            \
+      if (log_site.Allow(&log_suppressed))                                    \
+        ::cantera_wm::LogMessage(log_suppressed, __VA_ARGS__);               \
+    }                                                                         \
+  } while (0)
+
+#endif  // !LOG_H_
@@ -1,17 +1,20 @@
 #include <algorithm>
-#include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <set>
+#include <string>
+#include <vector>
 
 #include <err.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <signal.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sysexits.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <X11/Xatom.h>
@@ -20,17 +23,24 @@
 
 #include <X11/extensions/Xcomposite.h>
 #include <X11/extensions/Xinerama.h>
+#include <X11/extensions/Xrandr.h>
 #include <X11/extensions/Xrender.h>
 
 #include "cantera-wm.h"
+#include "capture.h"
+#include "compositor.h"
+#include "control.h"
+#include "event-loop.h"
+#include "ewmh.h"
+#include "launcher.h"
+#include "log.h"
 #include "menu.h"
+#include "settings.h"
 #include "tree.h"
 #include "xa.h"
 
 namespace cantera_wm {
 
-const size_t kWorkspaceCount = 24;
-
 Display* x_display;
 int x_screen_index;
 ::Screen* x_screen;
@@ -44,11 +54,10 @@ XIM x_im;
 XIC x_ic;
 int x_damage_eventbase;
 int x_damage_errorbase;
+int x_randr_eventbase;
 
 Session current_session;
 
-std::set<pid_t> children;
-
 void Screen::UpdateFocus(unsigned int workspace_index, Time x_event_time) {
   ::Window focus_window;
   bool hide_and_show;
@@ -57,51 +66,36 @@ void Screen::UpdateFocus(unsigned int workspace_index, Time x_event_time) {
 
   focus_window = x_root_window;
 
-  std::vector<cantera_wm::Window*> focus_candidates;
-
-  for (auto window : workspaces[workspace_index]) {
-    if (hide_and_show) window->show();
-
-    if (window->AcceptsInput()) focus_candidates.emplace_back(window);
+  if (hide_and_show) {
+    for (auto window : workspaces[workspace_index]) window->show();
   }
 
-  if (focus_candidates.empty()) {
-    fprintf(stderr, "No focus candidate windows in workspace %u\n",
-            workspace_index);
+  if (auto candidate = workspaces[workspace_index].FocusCandidate()) {
+    focus_window = candidate->x_window;
+  } else if (!workspaces.Empty(workspace_index)) {
+    LOG(kDebug, "No focus candidate windows in workspace %u",
+        workspace_index);
 
     for (auto window : workspaces[workspace_index]) {
-      fprintf(stderr, "  %s:", window->Description().c_str());
-
-      if (!window->AcceptsInput()) fprintf(stderr, " (doesn't accept input)");
-
-      fprintf(stderr, "\n");
-    }
-  } else {
-    if (focus_candidates.size() > 1) {
-      fprintf(stderr, "%zu focus candidate windows in workspace %u\n",
-              focus_candidates.size(), workspace_index);
-
-      for (const auto window : focus_candidates)
-        fprintf(stderr, "  %s: Type: %d\n", window->Description().c_str(),
-                static_cast<int>(window->Type()));
+      LOG(kDebug, "  %s:%s", window->Description().c_str(),
+          window->AcceptsInput() ? "" : " (doesn't accept input)");
     }
-
-    focus_window = focus_candidates.back()->x_window;
   }
 
   if (hide_and_show) {
+    current_session.StartTransition(
+        this, (workspace_index > active_workspace) ? 1 : -1);
+
     for (auto window : workspaces[active_workspace]) window->hide();
   }
 
   active_workspace = workspace_index;
 
-  XSetInputFocus(x_display, focus_window, RevertToParent, x_event_time);
-
-  // Set the _NET_ACTIVE_WINDOW property on the root window.
-  XChangeProperty(x_display, x_root_window, xa::net_active_window, XA_WINDOW,
-                  32, PropModeReplace, reinterpret_cast<unsigned char*>(
-                                           &focus_window),
-                  1);
+  // Bursts of focus changes, e.g. while the user flips through workspaces,
+  // reach the X server and other clients only once per batch of events.
+  QueueInputFocus(focus_window, x_event_time);
+  QueueProperty(x_root_window, xa::net_active_window, XA_WINDOW,
+                {static_cast<long>(focus_window)});
 }
 
 }  // namespace cantera_wm
@@ -110,7 +104,11 @@ using namespace cantera_wm;
 
 namespace {
 
-enum Option { kOptionEventLog = 'l' };
+enum Option {
+  kOptionEventLog = 'l',
+  kOptionFrameDump = 'd',
+  kOptionRestoreState = 'r'
+};
 
 int print_version;
 int print_help;
@@ -118,6 +116,8 @@ std::unique_ptr<FILE, decltype(&fclose)> event_log(nullptr, fclose);
 
 struct option kLongOptions[] = {
     {"event-log", required_argument, nullptr, kOptionEventLog},
+    {"frame-dump", required_argument, nullptr, kOptionFrameDump},
+    {"restore-state", required_argument, nullptr, kOptionRestoreState},
     {"version", no_argument, &print_version, 1},
     {"help", no_argument, &print_help, 1},
     {nullptr, 0, nullptr, 0}};
@@ -129,25 +129,56 @@ bool shift_pressed;
 
 int (*x_default_error_handler)(Display*, XErrorEvent* error);
 
-struct tree* config;
+volatile sig_atomic_t reload_requested;
+volatile sig_atomic_t restart_requested;
+
+// How to exec() ourselves on restart.  Paths are made absolute before we
+// change directory, and --restore-state is left out of the arguments.
+std::string program_path;
+std::vector<std::string> program_args;
+
+// Returns `path` relative to the working directory as an absolute path.
+// Symbolic links are kept, so that a restart after an upgrade that
+// repoints them picks up the new target.
+std::string AbsolutePath(const char* path) {
+  if (path[0] == '/') return path;
+
+  char* cwd = getcwd(nullptr, 0);
+  if (!cwd) return path;
+
+  std::string result = cwd;
+  free(cwd);
+
+  result += '/';
+  result += path;
+
+  return result;
+}
+
+// File descriptor of the state saved by the process we were exec()ed from,
+// or -1.
+int restore_state_fd = -1;
 
 int x_error_handler(Display* display, XErrorEvent* error) {
   int result = 0;
 
+  // Compositing threads only report errors caused by windows that went away
+  // on the main connection.
+  if (display != x_display) return 0;
+
   if (error->error_code == BadAccess &&
       error->request_code == X_ChangeWindowAttributes)
     errx(EXIT_FAILURE, "Another window manager is already running");
 
   if (error->error_code == BadWindow) {
-    fprintf(stderr, "Got BadWindow error for window 0x%lx\n",
-            error->resourceid);
+    LOG(kDebug, "Got BadWindow error for window 0x%lx", error->resourceid);
     current_session.remove_x_window(error->resourceid);
   } else if (error->error_code == x_damage_errorbase + BadDamage) {
-    fprintf(stderr, "BadDamage: 0x%lx\n", error->resourceid);
+    LOG(kWarning, "BadDamage: 0x%lx", error->resourceid);
   } else if (error->error_code == BadMatch) {
-    fprintf(stderr, "BadMatch: 0x%lx\n", error->resourceid);
+    LOG(kWarning, "BadMatch: 0x%lx", error->resourceid);
   } else {
-    fprintf(stderr, "Error: %d\n", error->error_code);
+    LOG(kWarning, "Error: %d", error->error_code);
   }
 
   return result;
@@ -163,6 +194,8 @@ void x_grab_keys() {
                                          Mod2Mask};
   size_t i, f, gmod;
 
+  XUngrabKey(x_display, AnyKey, AnyModifier, x_root_window);
+
   x_grab_key(XK_Alt_L, Mod4Mask);
   x_grab_key(XK_Alt_R, Mod4Mask);
 
@@ -190,6 +223,55 @@ void x_grab_keys() {
   }
 }
 
+std::vector<cantera_wm::Rectangle> x_query_screens() {
+  std::vector<cantera_wm::Rectangle> result;
+  int dummy;
+
+  if (XineramaQueryExtension(x_display, &dummy, &dummy) &&
+      XineramaIsActive(x_display)) {
+    XineramaScreenInfo* xinerama_screens;
+    int i, screen_count;
+
+    xinerama_screens = XineramaQueryScreens(x_display, &screen_count);
+
+    // There are no screens at all while every output is switched off.
+    if (xinerama_screens) {
+      std::sort(&xinerama_screens[0], &xinerama_screens[screen_count],
+                [](const auto& lhs, const auto& rhs) {
+                  return lhs.x_org < rhs.x_org;
+                });
+
+      for (i = 0; i < screen_count; ++i) {
+        cantera_wm::Rectangle geometry;
+        geometry.x = xinerama_screens[i].x_org;
+        geometry.y = xinerama_screens[i].y_org;
+        geometry.width = xinerama_screens[i].width;
+        geometry.height = xinerama_screens[i].height;
+
+        result.push_back(geometry);
+      }
+
+      XFree(xinerama_screens);
+    }
+  }
+
+  /* Xinerama not active or without screens -> assume one big screen */
+  if (result.empty()) {
+    XWindowAttributes root_window_attr;
+    XGetWindowAttributes(x_display, x_root_window, &root_window_attr);
+
+    cantera_wm::Rectangle geometry;
+    geometry.x = 0;
+    geometry.y = 0;
+    geometry.width = root_window_attr.width;
+    geometry.height = root_window_attr.height;
+
+    result.push_back(geometry);
+  }
+
+  return result;
+}
+
 void x_connect() {
   int dummy, major, minor;
   char* c;
@@ -209,7 +291,21 @@ void x_connect() {
       XGetVisualInfo(x_display, VisualNoMask, NULL, &x_visual_info_count);
   x_root_window = RootWindow(x_display, x_screen_index);
 
+  xa::cantera_wm_capture = XInternAtom(x_display, "_CANTERA_WM_CAPTURE", False);
   xa::net_active_window = XInternAtom(x_display, "_NET_ACTIVE_WINDOW", False);
+  xa::net_client_list = XInternAtom(x_display, "_NET_CLIENT_LIST", False);
+  xa::net_client_list_stacking =
+      XInternAtom(x_display, "_NET_CLIENT_LIST_STACKING", False);
+  xa::net_current_desktop =
+      XInternAtom(x_display, "_NET_CURRENT_DESKTOP", False);
+  xa::net_number_of_desktops =
+      XInternAtom(x_display, "_NET_NUMBER_OF_DESKTOPS", False);
+  xa::net_supported = XInternAtom(x_display, "_NET_SUPPORTED", False);
+  xa::net_workarea = XInternAtom(x_display, "_NET_WORKAREA", False);
+  xa::net_wm_pid = XInternAtom(x_display, "_NET_WM_PID", False);
+  xa::net_wm_strut = XInternAtom(x_display, "_NET_WM_STRUT", False);
+  xa::net_wm_strut_partial =
+      XInternAtom(x_display, "_NET_WM_STRUT_PARTIAL", False);
   xa::net_wm_window_type = XInternAtom(x_display, "_NET_WM_WINDOW_TYPE", False);
   xa::net_wm_window_type_desktop =
       XInternAtom(x_display, "_NET_WM_WINDOW_TYPE_DESKTOP", False);
@@ -253,42 +349,12 @@ void x_connect() {
 
   /*** Screen geometry ***/
 
-  if (XineramaQueryExtension(x_display, &dummy, &dummy) &&
-      XineramaIsActive(x_display)) {
-    XineramaScreenInfo* xinerama_screens;
-    int i, screen_count;
-
-    xinerama_screens = XineramaQueryScreens(x_display, &screen_count);
-    assert(screen_count >= 1);
-
-    std::sort(
-        &xinerama_screens[0], &xinerama_screens[screen_count],
-        [](const auto& lhs, const auto& rhs) { return lhs.x_org < rhs.x_org; });
-
-    for (i = 0; i < screen_count; ++i) {
-      cantera_wm::Screen new_screen;
-      new_screen.geometry.x = xinerama_screens[i].x_org;
-      new_screen.geometry.y = xinerama_screens[i].y_org;
-      new_screen.geometry.width = xinerama_screens[i].width;
-      new_screen.geometry.height = xinerama_screens[i].height;
-
-      current_session.AddScreen(new_screen);
-    }
-
-    XFree(xinerama_screens);
-  } else /* Xinerama not active -> assume one big screen */
-  {
-    XWindowAttributes root_window_attr;
-    XGetWindowAttributes(x_display, x_root_window, &root_window_attr);
-
-    cantera_wm::Screen new_screen;
-    new_screen.geometry.x = 0;
-    new_screen.geometry.y = 0;
-    new_screen.geometry.width = root_window_attr.width;
-    new_screen.geometry.height = root_window_attr.height;
+  if (XRRQueryExtension(x_display, &x_randr_eventbase, &dummy))
+    XRRSelectInput(x_display, x_root_window, RRScreenChangeNotifyMask);
+  else
+    x_randr_eventbase = -1;
 
-    current_session.AddScreen(new_screen);
-  }
+  current_session.UpdateScreens(x_query_screens());
 
   /*** Compositing ***/
 
@@ -306,123 +372,50 @@ void x_connect() {
                              &x_damage_errorbase))
     errx(EXIT_FAILURE, "Missing XDamage extension");
 
-  /* Create one window for each screen in which to composite its contents */
-
-  XSetWindowAttributes window_attr;
-  memset(&window_attr, 0, sizeof(window_attr));
-  window_attr.colormap = DefaultColormap(x_display, 0);
-  window_attr.event_mask = KeyPressMask | KeyReleaseMask | ButtonPressMask |
-                           ButtonReleaseMask | PointerMotionMask | ExposureMask;
-  window_attr.override_redirect = True;
-
-  XRenderPictureAttributes pa;
-  memset(&pa, 0, sizeof(pa));
-  pa.subwindow_mode = IncludeInferiors;
-
   XCompositeRedirectSubwindows(x_display, x_root_window,
                                CompositeRedirectManual);
 
-  for (size_t i = 0; i < current_session.ScreenCount(); ++i) {
-    cantera_wm::Screen* screen = current_session.GetScreen(i);
-
-    screen->x_window = XCreateWindow(
-        x_display, x_root_window, screen->geometry.x, screen->geometry.y,
-        screen->geometry.width, screen->geometry.height, 0, /* Border */
-        x_visual_info->depth, InputOutput, x_visual,
-        CWOverrideRedirect | CWColormap | CWEventMask, &window_attr);
-
-    current_session.AddInternalXWindow(screen->x_window);
-
-    XCompositeUnredirectWindow(x_display, screen->x_window,
-                               CompositeRedirectManual);
-
-    XMapWindow(x_display, screen->x_window);
-
-    if (!(screen->x_picture = XRenderCreatePicture(x_display, screen->x_window,
-                                                   x_render_visual_format,
-                                                   CPSubwindowMode, &pa)))
-      errx(EXIT_FAILURE, "Failed to create picture for screen window");
-
-    Pixmap pixmap;
-    pixmap = XCreatePixmap(x_display, screen->x_window, screen->geometry.width,
-                           screen->geometry.height, x_visual_info->depth);
-
-    if (!(screen->x_buffer = XRenderCreatePicture(
-              x_display, pixmap, x_render_visual_format, 0, 0)))
-      errx(EXIT_FAILURE, "Failed to create back buffer for screen");
-
-    XFreePixmap(x_display, pixmap);
-
-    fprintf(stderr, "Screen has window 0x%lx has buffer 0x%lx\n",
-            screen->x_window, screen->x_buffer);
-
-    /* Only the first screen window gets key events */
-    window_attr.event_mask &= ~(KeyPressMask | KeyReleaseMask);
-  }
+  /* The windows we composite into are created on the first paint */
 
   x_grab_keys();
 
-  fprintf(stderr, "Root has window %08lx\n", x_root_window);
-
-  menu_init();
-}
-
-pid_t launch_program(const char* command, Time when) {
-  char* args[4];
-  char buf[32];
-  pid_t pid;
-
-  sprintf(buf, "%zu", current_session.ActiveScreenIndex());
-  setenv("CURRENT_SCREEN", buf, 1);
-
-  args[0] = const_cast<char*>("/bin/sh");
-  args[1] = const_cast<char*>("-c");
-
-  if (-1 == asprintf(&args[2], "exec %s", command)) return -1;
-
-  args[3] = nullptr;
+  InitRootProperties();
 
-  /* Can't use vfork() because we want to call setsid */
+  LOG(kInfo, "Root has window %08lx", x_root_window);
 
-  if (-1 == (pid = fork())) return -1;
+  if (restore_state_fd != -1) {
+    if (FILE* input = fdopen(restore_state_fd, "r")) {
+      if (!current_session.RestoreState(input))
+        LOG(kWarning, "Saved state is incomplete");
 
-  if (pid) {
-    children.insert(pid);
+      fclose(input);
+    }
 
-    return pid;
+    restore_state_fd = -1;
   }
 
-  setsid();
-
-  execve(args[0], args, environ);
-
-  _exit(EXIT_FAILURE);
-}
-
-void wait_for_dead_children() {
-  int status;
-  pid_t child;
-
-  while (!children.empty() && (0 < (child = waitpid(-1, &status, WNOHANG))))
-    children.erase(child);
+  current_session.AdoptExistingWindows();
 }
 
 void HandleMapRequest(const XMapRequestEvent& xmaprequest) {
   cantera_wm::Screen* scr;
   workspace* ws;
   cantera_wm::Window* w;
+  bool visible = true;
 
   if (!(w = current_session.find_x_window(xmaprequest.window, &ws, &scr))) {
-    fprintf(stderr, "MapRequest received for unknown window %08lx\n",
-            xmaprequest.window);
+    LOG(kWarning, "MapRequest received for unknown window %08lx",
+        xmaprequest.window);
     return;
   }
 
   w->GetHints();
+  w->GetPID();
   w->ReadProperties();
+  w->SetMapped(true);
 
-  fprintf(stderr, "Map window %08lx of type %s\n", xmaprequest.window,
-          cantera_wm::Window::StringFromType(w->Type()));
+  LOG(kDebug, "Map window %08lx of type %s", xmaprequest.window,
+      cantera_wm::Window::StringFromType(w->Type()));
 
   if (!scr) scr = current_session.ActiveScreen();
 
@@ -434,71 +427,93 @@ void HandleMapRequest(const XMapRequestEvent& xmaprequest) {
 
       break;
 
+    case cantera_wm::Window::window_type_dock:
+      // Panels position themselves; they belong to the screen they are on.
+      scr = current_session.ScreenAt(w->position);
+
+      w->GetStrut();
+      current_session.move_window(w, scr, NULL);
+
+      if (w->HasStrut()) current_session.StrutsChanged();
+
+      break;
+
     default: {
       if (ws) break;
       unsigned int workspace;
 
       if (w->Type() == cantera_wm::Window::window_type_normal) {
-        // First, try remaining slots in current workspace.
-        for (workspace = scr->active_workspace; workspace < kWorkspaceCount;
-             ++workspace) {
-          if (scr->workspaces[workspace].empty()) break;
+        unsigned int first_workspace = scr->active_workspace;
+        bool focus = true;
+
+        // The first window of a program we launched goes to the screen and
+        // workspace that were active at launch, even if the user has moved
+        // on since.
+        if (auto child = FindChild(w->PID())) {
+          if (child->windows.empty()) {
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+
+            LOG(kInfo, "'%s' mapped its first window %.3f s after launch",
+                child->command.c_str(),
+                (now.tv_sec - child->launch_time.tv_sec) +
+                    (now.tv_nsec - child->launch_time.tv_nsec) * 1e-9);
+
+            if (child->screen_index < current_session.ScreenCount()) {
+              scr = current_session.GetScreen(child->screen_index);
+              first_workspace = child->workspace_index;
+              focus = (scr == current_session.ActiveScreen());
+            }
+          }
+
+          child->windows.push_back(w->x_window);
         }
 
-        if (workspace == kWorkspaceCount) {
-          // Next, try preceding slots in current workspace.
-          for (workspace = 0; workspace < scr->active_workspace; ++workspace) {
-            if (scr->workspaces[workspace].empty()) break;
-          }
+        // Try the slots following the current workspace, then the
+        // preceding ones.
+        int free_workspace = scr->workspaces.FindFree(
+            first_workspace, settings.workspace_count);
 
-          if (workspace == scr->active_workspace) {
-            fprintf(stderr,
-                    "All workspaces on current screen are in use.  Cannot map "
-                    "window\n");
-            return;
-          }
+        if (free_workspace < 0) {
+          LOG(kWarning,
+              "All workspaces on current screen are in use.  Cannot map "
+              "window");
+          return;
         }
 
-        scr->UpdateFocus(workspace, CurrentTime);
+        workspace = free_workspace;
+
+        if (focus) {
+          scr->UpdateFocus(workspace, CurrentTime);
 
-        auto& navstack = scr->navigation_stack;
+          auto& navstack = scr->navigation_stack;
 
-        navstack.erase(std::remove(navstack.begin(), navstack.end(), workspace),
-                       navstack.end());
-        navstack.push_back(workspace);
+          navstack.erase(
+              std::remove(navstack.begin(), navstack.end(), workspace),
+              navstack.end());
+          navstack.push_back(workspace);
+        } else if (workspace != scr->active_workspace) {
+          // Don't steal focus from the screen the user has moved to.
+          visible = false;
+        }
       } else {
         workspace = scr->active_workspace;
       }
 
-      ws = &scr->workspaces[workspace];
+      ws = &scr->workspaces.Get(workspace);
 
       current_session.move_window(w, scr, ws);
     }
   }
 
-  switch (w->Type()) {
-    case cantera_wm::Window::window_type_normal:
-      w->position = scr->geometry;
-      break;
-
-    default:
-      fprintf(stderr, "Unhandled type of window: %s\n",
-              cantera_wm::Window::StringFromType(w->Type()));
-    case cantera_wm::Window::window_type_dialog:
-      w->position.width = std::min(w->position.width, scr->geometry.width);
-      w->position.height = std::min(w->position.height, scr->geometry.height);
-      w->position.x =
-          scr->geometry.x + scr->geometry.width / 2 - w->position.width / 2;
-      w->position.y =
-          scr->geometry.y + scr->geometry.height / 2 - w->position.height / 2;
-  }
+  scr->PlaceWindow(w);
 
-  w->show();
+  if (visible)
+    w->show();
+  else
+    w->hide();
 
-  static unsigned long kMappedState[2] = {NormalState, None};
-  XChangeProperty(x_display, w->x_window, xa::wm_state, xa::wm_state, 32,
-                  PropModeReplace,
-                  reinterpret_cast<unsigned char*>(kMappedState), 2);
+  w->SetWMState(NormalState);
 
   XMapWindow(x_display, w->x_window);
 }
@@ -513,14 +528,23 @@ void ProcessEvent(XEvent& event) {
         case XA_WM_NAME: {
           const auto old_name = w->Description();
           w->GetName();
-          fprintf(stderr, "New name for %s: %s\n", old_name.c_str(),
-                  w->Description().c_str());
+          LOG(kDebug, "New name for %s: %s", old_name.c_str(),
+              w->Description().c_str());
         } break;
 
         case XA_WM_HINTS:
-          fprintf(stderr, "New WM hints for %s\n", w->Description().c_str());
+          LOG(kDebug, "New WM hints for %s", w->Description().c_str());
           w->GetWMHints();
           break;
+
+        default:
+          if (event.xproperty.atom == xa::net_wm_strut_partial ||
+              event.xproperty.atom == xa::net_wm_strut) {
+            bool had_strut = w->HasStrut();
+            w->GetStrut();
+
+            if (had_strut || w->HasStrut()) current_session.StrutsChanged();
+          }
       }
     } break;
 
@@ -530,6 +554,9 @@ void ProcessEvent(XEvent& event) {
       KeySym key_sym;
       int len;
 
+      // Animations must never delay the response to input.
+      current_session.FinishTransitions();
+
       ctrl_pressed = (event.xkey.state & ControlMask);
       mod1_pressed = (event.xkey.state & Mod1Mask);
       super_pressed = (event.xkey.state & Mod4Mask);
@@ -549,13 +576,11 @@ void ProcessEvent(XEvent& event) {
         mod1_pressed = true;
 
       if (key_sym >= 'a' && key_sym <= 'z' && super_pressed) {
-        char key[10];
-        const char* command;
-
-        sprintf(key, "hotkey.%c", (int)key_sym);
+        const auto& command = settings.hotkeys[key_sym - 'a'];
 
-        if (NULL != (command = tree_get_string_default(config, key, NULL)))
-          launch_program(command, event.xkey.time);
+        if (!command.empty())
+          LaunchProgram(command.c_str(), current_session.ActiveScreenIndex(),
+                        current_session.ActiveScreen()->active_workspace);
       } else if ((super_pressed ^ ctrl_pressed) && key_sym >= XK_F1 &&
                  key_sym <= XK_F12) {
         unsigned int new_active_workspace;
@@ -565,6 +590,8 @@ void ProcessEvent(XEvent& event) {
 
         if (super_pressed) new_active_workspace += 12;
 
+        if (new_active_workspace >= settings.workspace_count) break;
+
         current_session.ActiveScreen()->UpdateFocus(new_active_workspace,
                                                     event.xkey.time);
 
@@ -572,18 +599,20 @@ void ProcessEvent(XEvent& event) {
         scr->navigation_stack.clear();
         scr->navigation_stack.push_back(new_active_workspace);
 
-        current_session.SetDirty();
+        current_session.SetDirty(scr);
       } else if (super_pressed && key_sym >= XK_1 &&
                  key_sym < XK_1 + current_session.ScreenCount()) {
         unsigned int new_screen;
 
         new_screen = key_sym - XK_1;
 
+        current_session.SetDirty(current_session.ActiveScreen());
+
         current_session.SetActiveScreen(new_screen);
         current_session.ActiveScreen()->UpdateFocus(
             current_session.ActiveScreen()->active_workspace, event.xkey.time);
 
-        current_session.SetDirty();
+        current_session.SetDirty(current_session.ActiveScreen());
       } else if (super_pressed && (mod1_pressed ^ ctrl_pressed)) {
         int direction = 0;
         current_session.ShowMenu();
@@ -603,13 +632,13 @@ void ProcessEvent(XEvent& event) {
         }
         if (direction) {
           cantera_wm::Screen* scr = current_session.ActiveScreen();
+          unsigned int count = settings.workspace_count;
+          int step = direction % static_cast<int>(count);
           unsigned int new_workspace =
-              (kWorkspaceCount + scr->active_workspace + direction) %
-              kWorkspaceCount;
+              (scr->active_workspace + count + step) % count;
 
           if (ctrl_pressed) {
-            scr->workspaces[scr->active_workspace].swap(
-                scr->workspaces[new_workspace]);
+            scr->workspaces.Swap(scr->active_workspace, new_workspace);
             if (!scr->navigation_stack.empty())
               scr->navigation_stack.back() = new_workspace;
             scr->active_workspace = new_workspace;
@@ -622,7 +651,7 @@ void ProcessEvent(XEvent& event) {
           }
         }
 
-        current_session.SetDirty();
+        current_session.SetDirty(current_session.ActiveScreen());
       } else if (mod1_pressed && key_sym == XK_F4) {
         XClientMessageEvent cme;
         cantera_wm::Screen* scr;
@@ -669,11 +698,11 @@ void ProcessEvent(XEvent& event) {
     } break;
 
     case CreateNotify: {
-      fprintf(stderr,
-              "Window created (%d, %d, %d, %d), parent 0x%lx (root = 0x%lx)\n",
-              event.xcreatewindow.x, event.xcreatewindow.y,
-              event.xcreatewindow.width, event.xcreatewindow.height,
-              event.xcreatewindow.parent, x_root_window);
+      LOG(kDebug,
+          "Window created (%d, %d, %d, %d), parent 0x%lx (root = 0x%lx)",
+          event.xcreatewindow.x, event.xcreatewindow.y,
+          event.xcreatewindow.width, event.xcreatewindow.height,
+          event.xcreatewindow.parent, x_root_window);
 
       current_session.ProcessXCreateWindowEvent(event.xcreatewindow);
     } break;
@@ -699,8 +728,7 @@ void ProcessEvent(XEvent& event) {
       workspace* ws;
       cantera_wm::Window* w;
 
-      fprintf(stderr, "Window 0x%lx was unmapped\n",
-              destroy_event.xdestroywindow.window);
+      LOG(kDebug, "Window 0x%lx was unmapped", event.xunmap.window);
 
       /* Window is probably destroyed, so we check that first */
       while (XCheckTypedWindowEvent(x_display, x_root_window, DestroyNotify,
@@ -711,19 +739,38 @@ void ProcessEvent(XEvent& event) {
       if (NULL !=
           (w = current_session.find_x_window(event.xunmap.window, &ws, &scr))) {
         w->reset_composite();
-        current_session.SetDirty();
+        w->SetMapped(false);
+
+        if (scr)
+          current_session.SetDirty(scr);
+        else
+          current_session.SetDirty(w->real_position);
+
+        if (scr && ws == &scr->workspaces[scr->active_workspace])
+          scr->UpdateFocus(scr->active_workspace, CurrentTime);
       }
     } break;
 
+    case FocusIn: {
+      if (event.xfocus.mode == NotifyGrab || event.xfocus.mode == NotifyUngrab)
+        break;
+
+      if (auto w = current_session.find_x_window(event.xfocus.window))
+        w->MarkFocused();
+    } break;
+
     case ConfigureNotify: {
       if (auto w = current_session.find_x_window(event.xconfigure.window)) {
+        // Repaint wherever the window was, and wherever it is now.
+        current_session.SetDirty(w->real_position);
+
         w->real_position.x = event.xconfigure.x;
         w->real_position.y = event.xconfigure.y;
         w->real_position.width = event.xconfigure.width;
         w->real_position.height = event.xconfigure.height;
-      }
 
-      current_session.SetDirty();
+        current_session.SetDirty(w->real_position);
+      }
     } break;
 
     case ConfigureRequest: {
@@ -758,7 +805,11 @@ void ProcessEvent(XEvent& event) {
     } break;
 
     default: {
-      if (event.type == x_damage_eventbase + XDamageNotify) {
+      if (event.type == x_randr_eventbase + RRScreenChangeNotify) {
+        XRRUpdateConfiguration(&event);
+
+        if (current_session.UpdateScreens(x_query_screens())) x_grab_keys();
+      } else if (event.type == x_damage_eventbase + XDamageNotify) {
         const auto& dne = *reinterpret_cast<XDamageNotifyEvent*>(&event);
 
         cantera_wm::Screen* scr;
@@ -798,13 +849,83 @@ void ProcessEvent(XEvent& event) {
   }
 }
 
+void reload_config() {
+  struct tree* config;
+  Settings new_settings;
+
+  config = tree_load_cfg(".cantera/config");
+  LoadSettings(config, &new_settings);
+  tree_destroy(config);
+
+  // Transitions in progress use the old animation duration.
+  current_session.FinishTransitions();
+
+  settings = new_settings;
+  log_level.store(settings.log_level, std::memory_order_relaxed);
+
+  current_session.FitWorkspaces();
+}
+
+// Replaces this process with a fresh copy of the program file, e.g. after
+// an upgrade, handing over the session through a memfd.  The X connection
+// is closed first so that the new process can become the window manager.
+[[noreturn]] void Restart() {
+  char buf[32];
+  int fd;
+
+  LOG(kInfo, "Restarting");
+
+  WaitForCompositeJobs();
+  ShutDownLauncher();
+
+  if (-1 == (fd = memfd_create("cantera-wm-state", MFD_CLOEXEC)))
+    err(EXIT_FAILURE, "Failed to create memfd for restart");
+
+  if (FILE* output = fdopen(dup(fd), "w")) {
+    current_session.SaveState(output);
+
+    if (ferror(output) || fclose(output))
+      LOG(kWarning, "Failed to save state; windows will be adopted instead");
+  }
+
+  lseek(fd, 0, SEEK_SET);
+
+  FlushRootProperties();
+  XCloseDisplay(x_display);
+
+  FlushLog();
+
+  sprintf(buf, "--restore-state=%d", fd);
+
+  // Only the new process may inherit the state; it sets FD_CLOEXEC again.
+  fcntl(fd, F_SETFD, 0);
+
+  std::vector<char*> args;
+  args.push_back(&program_path[0]);
+  for (auto& arg : program_args) args.push_back(&arg[0]);
+  args.push_back(buf);
+  args.push_back(nullptr);
+
+  execvp(args[0], args.data());
+
+  err(EXIT_FAILURE, "Failed to execute '%s'", args[0]);
+}
+
 void x_process_events() {
   current_session.SetDirty();
 
   for (;;) {
-    wait_for_dead_children();
+    if (reload_requested) {
+      reload_requested = 0;
+      reload_config();
+    }
 
-    while (!current_session.Dirty() || XPending(x_display)) {
+    if (restart_requested) Restart();
+
+    ReapChildren();
+    RunTimers();
+
+    while (XPending(x_display)) {
       XEvent event;
       XNextEvent(x_display, &event);
 
@@ -833,22 +954,36 @@ void x_process_events() {
       }
     }
 
-    current_session.Paint();
-  }
-}
+    current_session.UpdateWorkAreas();
 
-void reload_config() {
-  if (config) tree_destroy(config);
+    // All property changes caused by this batch of events go out together.
+    FlushRootProperties();
 
-  config = tree_load_cfg(".cantera/config");
+    if (current_session.Dirty()) {
+      current_session.Paint();
+
+      continue;
+    }
+
+    // FlushRootProperties() has sent our requests, and the event queue is
+    // empty, so we can sleep until something happens.
+    WaitForEvents(ConnectionNumber(x_display));
+  }
 }
 
 void sighandler(int signal) {
   switch (signal) {
     case SIGUSR1:
-      reload_config();
+      reload_requested = 1;
+      break;
+
+    case SIGUSR2:
+      restart_requested = 1;
       break;
   }
+
+  // The main loop may have checked the flags already and be about to block.
+  WakeUp();
 }
 
 }  // namespace
@@ -867,16 +1002,43 @@ int main(int argc, char** argv) {
           if (fd == -1)
             err(EXIT_FAILURE, "Failed to open '%s' for writing", optarg);
           event_log.reset(fdopen(fd, "a"));
+          program_args.push_back("--event-log=" + AbsolutePath(optarg));
+        }
+        break;
+
+      case kOptionFrameDump:
+        // Resolved now, since we chdir() to $HOME below.
+        {
+          char* path = realpath(optarg, nullptr);
+          if (!path) err(EXIT_FAILURE, "Unable to resolve '%s'", optarg);
+          SetFrameDumpDirectory(path);
+          program_args.push_back(std::string("--frame-dump=") + path);
+          free(path);
         }
         break;
+
+      case kOptionRestoreState:
+        restore_state_fd = atoi(optarg);
+
+        // Keep the launcher and the programs it starts from inheriting the
+        // saved session.
+        fcntl(restore_state_fd, F_SETFD, FD_CLOEXEC);
+        break;
     }
   }
 
+  // A bare name is looked up in $PATH again on restart.
+  program_path = strchr(argv[0], '/') ? AbsolutePath(argv[0]) : argv[0];
+
+  for (int j = optind; j < argc; ++j) program_args.push_back(argv[j]);
+
   if (print_help) {
     printf(
         "Usage: %s [OPTION]... [FILE]...\n"
         "\n"
         "      --event-log=PATH            write X11 events to PATH\n"
+        "      --frame-dump=DIR            write every painted frame to DIR\n"
+        "      --restore-state=FD          continue the session saved in FD\n"
         "      --help     display this help and exit\n"
         "      --version  display version information and exit\n"
         "\n"
@@ -894,7 +1056,10 @@ int main(int argc, char** argv) {
     return EXIT_SUCCESS;
   }
 
+  InitEventLoop();
+
   signal(SIGUSR1, sighandler);
+  signal(SIGUSR2, sighandler);
 
   char* home;
   if (!(home = getenv("HOME")))
@@ -907,6 +1072,15 @@ int main(int argc, char** argv) {
 
   reload_config();
 
+  if (settings.parallel_compositing) EnableParallelCompositing();
+
+  StartControlSocket();
+  StartLauncher();
+
+  // After the launcher helper has forked, so that it never inherits a ring
+  // without the thread draining it.
+  StartLogThread();
+
   x_connect();
 
   x_process_events();
@@ -16,17 +16,22 @@
 #include <sys/utsname.h>
 #include <time.h>
 #include <unistd.h>
-#include <wchar.h>
 
 #include <X11/extensions/Xrender.h>
 
 #include "cantera-wm.h"
+#include "font.h"
 #include "menu.h"
+#include "settings.h"
 
 using namespace cantera_wm;
 #define SMALL 0
 static const int yskips[] = { 10, 15 };
 
+static const char kMenuFont[] = "sans-serif:pixelsize=12";
+
+static std::unique_ptr<cantera_wm::Font> menu_font;
+
 static const XTransform xform_identity = {
   { { 0x10000, 0, 0 }, { 0, 0x10000, 0 }, { 0, 0, 0x10000 } }
 };
@@ -37,57 +42,56 @@ void menu_thumbnail_dimensions(const cantera_wm::Screen& scr,
 
 void menu_draw_desktops(const cantera_wm::Screen& scr);
 
-void menu_init(void) {
-  for (size_t i = 0; i < current_session.ScreenCount(); ++i) {
-    cantera_wm::Screen* screen = current_session.GetScreen(i);
-    unsigned int previous_width, previous_height;
-    unsigned int current_width, current_height;
-    unsigned int thumb_width, thumb_height;
-    XTransform xform_scaled;
-    Picture temp_picture;
+void menu_init_screen(cantera_wm::Screen* screen) {
+  unsigned int previous_width, previous_height;
+  unsigned int current_width, current_height;
+  unsigned int thumb_width, thumb_height;
+  XTransform xform_scaled;
+  Picture temp_picture;
 
-    menu_thumbnail_dimensions(*screen, &thumb_width, &thumb_height, NULL);
+  menu_thumbnail_dimensions(*screen, &thumb_width, &thumb_height, NULL);
 
-    previous_width = screen->geometry.width;
-    previous_height = screen->geometry.height;
+  if (!menu_font) menu_font = cantera_wm::Font::Open(kMenuFont);
 
-    for (;;) {
-      Pixmap temp_pixmap;
+  previous_width = screen->geometry.width;
+  previous_height = screen->geometry.height;
 
-      current_width = previous_width >> 1;
-      current_height = previous_height >> 1;
+  for (;;) {
+    Pixmap temp_pixmap;
 
-      if (current_width <= thumb_width) current_width = thumb_width;
+    current_width = previous_width >> 1;
+    current_height = previous_height >> 1;
 
-      if (current_height <= thumb_height) current_height = thumb_height;
+    if (current_width <= thumb_width) current_width = thumb_width;
 
-      xform_scaled = xform_identity;
-      xform_scaled.matrix[2][2] =
-          XDoubleToFixed((double) current_width / previous_width);
+    if (current_height <= thumb_height) current_height = thumb_height;
 
-      if (screen->resize_buffers.empty())
-        screen->initial_transform = xform_scaled;
-      else
-        XRenderSetPictureTransform(x_display, temp_picture, &xform_scaled);
+    xform_scaled = xform_identity;
+    xform_scaled.matrix[2][2] =
+        XDoubleToFixed((double) current_width / previous_width);
 
-      if (current_width == thumb_width) break;
+    if (screen->resize_buffers.empty())
+      screen->initial_transform = xform_scaled;
+    else
+      XRenderSetPictureTransform(x_display, temp_picture, &xform_scaled);
 
-      temp_pixmap = XCreatePixmap(x_display, x_root_window, current_width,
-                                  current_height, 32);
+    if (current_width == thumb_width) break;
 
-      temp_picture = XRenderCreatePicture(
-          x_display, temp_pixmap,
-          XRenderFindStandardFormat(x_display, PictStandardARGB32), 0, 0);
+    temp_pixmap = XCreatePixmap(x_display, x_root_window, current_width,
+                                current_height, 32);
 
-      XRenderSetPictureFilter(x_display, temp_picture, FilterBilinear, 0, 0);
+    temp_picture = XRenderCreatePicture(
+        x_display, temp_pixmap,
+        XRenderFindStandardFormat(x_display, PictStandardARGB32), 0, 0);
 
-      XFreePixmap(x_display, temp_pixmap);
+    XRenderSetPictureFilter(x_display, temp_picture, FilterBilinear, 0, 0);
 
-      screen->resize_buffers.push_back(temp_picture);
+    XFreePixmap(x_display, temp_pixmap);
 
-      previous_width = current_width;
-      previous_height = current_height;
-    }
+    screen->resize_buffers.push_back(temp_picture);
+
+    previous_width = current_width;
+    previous_height = current_height;
   }
 }
 
@@ -112,28 +116,101 @@ void menu_draw(const cantera_wm::Screen& scr) {
   menu_draw_desktops(scr);
 }
 
-void menu_draw_desktops(const cantera_wm::Screen& scr) {
-  unsigned int thumb_width, thumb_height, thumb_margin;
-  size_t i;
-  int x = 0, y;
+/* Returns the baseline of the clock line, which is above the workspace
+ * rows.  */
+static int menu_clock_baseline(const cantera_wm::Screen& scr) {
+  unsigned int thumb_height, thumb_margin, rows;
+
+  menu_thumbnail_dimensions(scr, NULL, &thumb_height, &thumb_margin);
+
+  rows = (settings.workspace_count + 11) / 12;
+
+  return scr.geometry.height - rows * (thumb_height + thumb_margin) -
+         yskips[SMALL] - thumb_margin - menu_font->Descent();
+}
+
+void menu_clock_area(const cantera_wm::Screen& scr, XRectangle* area) {
+  unsigned int thumb_margin;
+
+  menu_thumbnail_dimensions(scr, NULL, NULL, &thumb_margin);
+
+  area->x = thumb_margin;
+  area->width = scr.geometry.width - 2 * thumb_margin;
+
+  if (!menu_font) {
+    area->y = 0;
+    area->height = 0;
+
+    return;
+  }
+
+  area->y = menu_clock_baseline(scr) - menu_font->Ascent();
+  area->height = menu_font->Ascent() + menu_font->Descent();
+}
+
+void menu_draw_clock(const cantera_wm::Screen& scr) {
+  static const XRenderColor clock_color = { 0xffff, 0xffff, 0xffff, 0xffff };
+  unsigned int thumb_margin;
   time_t ttnow;
   struct tm* tmnow;
-  wchar_t wbuf[256];
   char buf[256];
+  size_t length;
 
-  menu_thumbnail_dimensions(scr, &thumb_width, &thumb_height, &thumb_margin);
+  if (!menu_font) return;
+
+  menu_thumbnail_dimensions(scr, NULL, NULL, &thumb_margin);
 
   ttnow = time(0);
   tmnow = localtime(&ttnow);
-  strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", tmnow);
-  swprintf(wbuf, sizeof(wbuf) / sizeof(wbuf[0]), L"%s", buf);
-  i = wcslen(wbuf);
-  swprintf(&wbuf[i], sizeof(wbuf) / sizeof(wbuf[0]) - i, L"  %s",
-           PACKAGE_STRING);
+
+  /* strftime returns 0 for an empty result, but also for one that does not
+   * fit, so the buffer may hold anything then.  */
+  length = strftime(buf, sizeof(buf), settings.menu_clock_format.c_str(),
+                    tmnow);
+
+  if (!length) return;
+
+  menu_font->Draw(scr.x_buffer, thumb_margin, menu_clock_baseline(scr),
+                  clock_color, buf);
+}
+
+static void menu_draw_label(const cantera_wm::Screen& scr, int x, int y,
+                            unsigned int thumb_width,
+                            unsigned int thumb_height, size_t workspace) {
+  static const XRenderColor text_color = { 0xdddd, 0xdddd, 0xdddd, 0xffff };
+  char number[16];
+
+  if (!menu_font) return;
+
+  snprintf(number, sizeof(number), "%zu", workspace + 1);
+
+  menu_font->Draw(scr.x_buffer, x + 3, y + 2 + menu_font->Ascent(),
+                  text_color, number);
+
+  if (scr.workspaces[workspace].empty()) return;
+
+  const cantera_wm::Window* w = scr.workspaces[workspace].back();
+
+  menu_font->Draw(scr.x_buffer, x + 3,
+                  y + thumb_height - 2 - menu_font->Descent(), text_color,
+                  w->Name().empty() ? w->Description() : w->Name(),
+                  thumb_width - 6);
+}
+
+void menu_draw_desktops(const cantera_wm::Screen& scr) {
+  unsigned int thumb_width, thumb_height, thumb_margin;
+  size_t i, rows;
+  int x = 0, y;
+
+  menu_thumbnail_dimensions(scr, &thumb_width, &thumb_height, &thumb_margin);
 
   x = thumb_margin;
 
-  for (i = 0; i < 24; ++i) {
+  rows = (settings.workspace_count + 11) / 12;
+
+  menu_draw_clock(scr);
+
+  for (i = 0; i < settings.workspace_count; ++i) {
     XRenderColor border_color;
     unsigned int buffer_width, buffer_height;
 
@@ -144,11 +221,8 @@ void menu_draw_desktops(const cantera_wm::Screen& scr) {
     else if ((i % 12) > 3)
       x += 2 * thumb_margin;
 
-    if (i < 12)
-      y = scr.geometry.height - 2 * thumb_height - 2 * thumb_margin -
-          yskips[SMALL];
-    else
-      y = scr.geometry.height - thumb_height - thumb_margin - yskips[SMALL];
+    y = scr.geometry.height - (rows - i / 12) * (thumb_height + thumb_margin) -
+        yskips[SMALL];
 
     border_color.alpha = 0xffff;
 
@@ -187,9 +261,23 @@ void menu_draw_desktops(const cantera_wm::Screen& scr) {
       XRenderFillRectangle(x_display, PictOpOver, scr.x_buffer, &fill_color, x,
                            y, thumb_width, thumb_height);
 
+      menu_draw_label(scr, x, y, thumb_width, thumb_height, i);
+
       continue;
     }
 
+    // Translucent windows are blended onto black, as on screen.
+    XRenderColor black;
+
+    black.red = 0x0000;
+    black.green = 0x0000;
+    black.blue = 0x0000;
+    black.alpha = 0xffff;
+
+    XRenderFillRectangle(x_display, PictOpSrc, scr.resize_buffers.front(),
+                         &black, 0, 0, scr.geometry.width >> 1,
+                         scr.geometry.height >> 1);
+
     for (auto& w : scr.workspaces[i]) {
       int scaled_x, scaled_y, scaled_width, scaled_height;
 
@@ -199,17 +287,13 @@ void menu_draw_desktops(const cantera_wm::Screen& scr) {
       scaled_y = (w->position.y - scr.geometry.y) >> 1;
       scaled_height = w->position.height >> 1;
 
-      XRenderSetPictureTransform(x_display, w->x_picture,
-                                 (XTransform*)&scr.initial_transform);
-      XRenderSetPictureFilter(x_display, w->x_picture, FilterBilinear, 0, 0);
+      Picture thumbnail = w->ThumbnailPicture(scr.initial_transform);
 
-      XRenderComposite(x_display, PictOpSrc, w->x_picture, None,
-                       scr.resize_buffers.front(), 0, 0, 0, 0, scaled_x,
-                       scaled_y, scaled_width, scaled_height);
+      if (!thumbnail) continue;
 
-      XRenderSetPictureTransform(x_display, w->x_picture,
-                                 (XTransform*)&xform_identity);
-      XRenderSetPictureFilter(x_display, w->x_picture, FilterNearest, 0, 0);
+      XRenderComposite(x_display, w->Opaque() ? PictOpSrc : PictOpOver,
+                       thumbnail, None, scr.resize_buffers.front(), 0, 0, 0, 0,
+                       scaled_x, scaled_y, scaled_width, scaled_height);
     }
 
     buffer_width = scr.geometry.width;
@@ -226,5 +310,7 @@ void menu_draw_desktops(const cantera_wm::Screen& scr) {
 
     XRenderComposite(x_display, PictOpSrc, scr.resize_buffers.back(), None,
                      scr.x_buffer, 0, 0, 0, 0, x, y, thumb_width, thumb_height);
+
+    menu_draw_label(scr, x, y, thumb_width, thumb_height, i);
   }
 }
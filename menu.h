@@ -1,5 +1,11 @@
 #include "cantera-wm.h"
 
-void menu_init(void);
+void menu_init_screen(cantera_wm::Screen* screen);
 
 void menu_draw(const cantera_wm::Screen& scr);
+
+/* Returns the part of the screen covered by the menu clock.  */
+void menu_clock_area(const cantera_wm::Screen& scr, XRectangle* area);
+
+/* Draws the menu clock into the back buffer of `scr`.  */
+void menu_draw_clock(const cantera_wm::Screen& scr);
@@ -0,0 +1,179 @@
+/* Scripted client for render-test.sh.
+ *
+ *   render-client window COLOR [TYPE [WIDTHxHEIGHT]]
+ *     Maps a window of WIDTHxHEIGHT pixels, 64x64 by default, named COLOR and
+ *     filled with it, whose _NET_WM_WINDOW_TYPE is _NET_WM_WINDOW_TYPE_TYPE,
+ *     "NORMAL" by default, and keeps it filled until killed.  COLOR is
+ *     RRGGBB, or AARRGGBB with premultiplied components for a translucent
+ *     window.
+ *
+ *   render-client control COMMAND...
+ *     Sends the commands as one batch to the control socket named by
+ *     CANTERA_WM_SOCKET, prints the reply, and exits with 0 only if every
+ *     command succeeded.  */
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <err.h>
+
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+static int run_window(const char *color_name, const char *type_name,
+                      const char *size) {
+  Display *display;
+  Window window;
+  GC gc;
+  Atom type;
+  char type_atom_name[64];
+  unsigned long color;
+  unsigned int width = 64, height = 64;
+
+  color = strtoul(color_name, NULL, 16);
+
+  if (size && 2 != sscanf(size, "%ux%u", &width, &height))
+    errx(EXIT_FAILURE, "Expected WIDTHxHEIGHT, found '%s'", size);
+
+  if (!(display = XOpenDisplay(NULL)))
+    errx(EXIT_FAILURE, "XOpenDisplay failed");
+
+  if (strlen(color_name) > 6) {
+    /* The ARGB visual that the Composite extension adds.  */
+    XVisualInfo visual_info;
+    XSetWindowAttributes attributes;
+
+    if (!XMatchVisualInfo(display, DefaultScreen(display), 32, TrueColor,
+                          &visual_info))
+      errx(EXIT_FAILURE, "No 32-bit TrueColor visual");
+
+    attributes.colormap =
+        XCreateColormap(display, DefaultRootWindow(display),
+                        visual_info.visual, AllocNone);
+    attributes.background_pixel = color;
+    attributes.border_pixel = 0;
+
+    window = XCreateWindow(display, DefaultRootWindow(display), 0, 0, width,
+                           height, 0, 32, InputOutput, visual_info.visual,
+                           CWColormap | CWBackPixel | CWBorderPixel,
+                           &attributes);
+  } else {
+    /* TrueColor at depth 24 is the default visual of Xvfb.  */
+    window = XCreateSimpleWindow(display, DefaultRootWindow(display), 0, 0,
+                                 width, height, 0, color, color);
+  }
+
+  /* The menu labels thumbnails with window names.  */
+  XStoreName(display, window, color_name);
+
+  snprintf(type_atom_name, sizeof(type_atom_name), "_NET_WM_WINDOW_TYPE_%s",
+           type_name);
+  type = XInternAtom(display, type_atom_name, False);
+
+  XChangeProperty(display, window,
+                  XInternAtom(display, "_NET_WM_WINDOW_TYPE", False), XA_ATOM,
+                  32, PropModeReplace, (unsigned char *)&type, 1);
+
+  XSelectInput(display, window, ExposureMask | StructureNotifyMask);
+  XMapWindow(display, window);
+
+  gc = XCreateGC(display, window, 0, NULL);
+  XSetForeground(display, gc, color);
+
+  /* The window manager clears new window pictures after we may already
+   * have drawn, so the window is filled again periodically rather than only
+   * on Expose.  */
+  for (;;) {
+    struct pollfd pfd;
+
+    XFillRectangle(display, window, gc, 0, 0, 0xffff, 0xffff);
+    XFlush(display);
+
+    pfd.fd = ConnectionNumber(display);
+    pfd.events = POLLIN;
+    poll(&pfd, 1, 100);
+
+    while (XPending(display)) {
+      XEvent event;
+
+      XNextEvent(display, &event);
+    }
+  }
+}
+
+static int run_control(int argc, char **argv) {
+  struct sockaddr_un address;
+  const char *path;
+  char message[4096], reply[65536];
+  size_t length = 0;
+  ssize_t ret;
+  int fd, i, result = EXIT_SUCCESS;
+  char *line;
+
+  if (!(path = getenv("CANTERA_WM_SOCKET")))
+    errx(EXIT_FAILURE, "CANTERA_WM_SOCKET is not set");
+
+  for (i = 0; i < argc; ++i) {
+    size_t command_length = strlen(argv[i]);
+
+    if (length + command_length + 1 > sizeof(message))
+      errx(EXIT_FAILURE, "Too many commands");
+
+    memcpy(message + length, argv[i], command_length);
+    length += command_length;
+    message[length++] = '\n';
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (strlen(path) >= sizeof(address.sun_path))
+    errx(EXIT_FAILURE, "Socket path '%s' is too long", path);
+
+  strcpy(address.sun_path, path);
+
+  if (-1 == (fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)))
+    err(EXIT_FAILURE, "Failed to create socket");
+
+  if (-1 == connect(fd, (struct sockaddr *)&address, sizeof(address)))
+    err(EXIT_FAILURE, "Failed to connect to '%s'", path);
+
+  if (-1 == send(fd, message, length, 0))
+    err(EXIT_FAILURE, "Failed to send commands");
+
+  if (-1 == (ret = recv(fd, reply, sizeof(reply) - 1, 0)))
+    err(EXIT_FAILURE, "Failed to receive reply");
+
+  reply[ret] = 0;
+  fputs(reply, stdout);
+
+  for (line = strtok(reply, "\n"); line; line = strtok(NULL, "\n")) {
+    if (!strncmp(line, "error", 5)) result = EXIT_FAILURE;
+  }
+
+  close(fd);
+
+  return result;
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 3 && !strcmp(argv[1], "window"))
+    return run_window(argv[2], (argc > 3) ? argv[3] : "NORMAL",
+                      (argc > 4) ? argv[4] : NULL);
+
+  if (argc >= 3 && !strcmp(argv[1], "control"))
+    return run_control(argc - 2, argv + 2);
+
+  fprintf(stderr,
+          "Usage: %s window COLOR [TYPE [WIDTHxHEIGHT]]\n"
+          "       %s control COMMAND...\n",
+          argv[0], argv[0]);
+
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,199 @@
+#!/bin/sh
+# Runs cantera-wm on Xvfb, drives it with scripted clients and the control
+# socket, and compares the frames it paints with the golden images in
+# goldens/.  Exits with 77, which automake reports as a skip, if Xvfb is
+# missing.
+#
+# Set UPDATE_GOLDENS=1 to store the frames as new golden images instead,
+# e.g. after an intended rendering change.  Frames without a golden are
+# reported but not compared.
+#
+# Text is drawn with the font in goldens/fonts only, and the menu clock is
+# fixed, so the menu frame depends on the FreeType version at most.
+
+set -e
+
+srcdir=${srcdir:-.}
+goldens="$srcdir/goldens"
+
+# Per-channel difference allowed between a frame and its golden.
+tolerance=8
+
+if ! command -v Xvfb > /dev/null 2>&1; then
+  echo "Xvfb not found; skipping"
+  exit 77
+fi
+
+tmp=$(mktemp -d)
+xvfb_pid=
+wm_pid=
+client_pids=
+
+cleanup() {
+  for pid in $client_pids $wm_pid $xvfb_pid; do
+    kill "$pid" 2> /dev/null || true
+  done
+
+  wait 2> /dev/null || true
+  rm -rf "$tmp"
+}
+
+trap cleanup EXIT
+
+# Waits up to 5 seconds for `test $@` to succeed.
+wait_for() {
+  tries=50
+
+  until test "$@"; do
+    tries=$((tries - 1))
+
+    if [ $tries = 0 ]; then
+      echo "Timed out waiting for test $*"
+      exit 1
+    fi
+
+    sleep 0.1
+  done
+}
+
+Xvfb -displayfd 3 -screen 0 320x240x24 -nolisten tcp 3> "$tmp/display" \
+  2> "$tmp/xvfb.log" &
+xvfb_pid=$!
+
+wait_for -s "$tmp/display"
+
+DISPLAY=:$(cat "$tmp/display")
+HOME="$tmp/home"
+XDG_RUNTIME_DIR="$tmp"
+CANTERA_WM_SOCKET="$tmp/cantera-wm$DISPLAY"
+export DISPLAY HOME XDG_RUNTIME_DIR CANTERA_WM_SOCKET
+
+mkdir "$HOME" "$HOME/.cantera" "$tmp/frames"
+
+cat > "$HOME/.cantera/config" << EOF
+log.level warning
+menu.clock_format "2000-01-01 00:00:00"
+workspace.animation 0
+EOF
+
+FONTCONFIG_FILE="$tmp/fonts.conf"
+export FONTCONFIG_FILE
+
+cat > "$FONTCONFIG_FILE" << EOF
+<?xml version="1.0"?>
+<!DOCTYPE fontconfig SYSTEM "fonts.dtd">
+<fontconfig>
+  <dir>$(cd "$goldens/fonts" && pwd)</dir>
+  <cachedir>$tmp/fontconfig</cachedir>
+</fontconfig>
+EOF
+
+./cantera-wm --frame-dump="$tmp/frames" 2> "$tmp/cantera-wm.log" &
+wm_pid=$!
+
+wait_for -S "$CANTERA_WM_SOCKET"
+
+frame_count() {
+  ls "$tmp/frames" | wc -l
+}
+
+# Waits until the window manager has stopped painting, then keeps its last
+# frame of the first screen as $tmp/NAME.ppm.
+capture() {
+  last=$(frame_count)
+  quiet=0
+
+  while [ $quiet -lt 5 ]; do
+    sleep 0.1
+    count=$(frame_count)
+
+    if [ "$count" = "$last" ]; then
+      quiet=$((quiet + 1))
+    else
+      quiet=0
+      last=$count
+    fi
+  done
+
+  frame=$(ls "$tmp/frames" | grep -- '-0\.ppm$' | sort | tail -n 1)
+  cp "$tmp/frames/$frame" "$tmp/$1.ppm"
+}
+
+map_window() {
+  ./render-client window "$@" &
+  client_pids="$client_pids $!"
+}
+
+control() {
+  ./render-client control "$@" > /dev/null
+}
+
+# The first window takes the first workspace, and the second the next free
+# one, which is then shown.
+map_window ff0000
+capture workspace-0
+
+map_window 0000ff
+capture workspace-1
+
+control "workspace 0"
+capture workspace-0-again
+
+control "menu show"
+capture menu
+
+control "menu hide"
+capture workspace-0-after-menu
+
+# Dialogs are centered on the active workspace, above its window.  The
+# second one is translucent and blended onto both.
+map_window 00ff00 DIALOG 160x120
+capture dialog
+
+map_window 80000080 DIALOG 64x64
+capture translucent
+
+failed=0
+compared=0
+
+# Captures of the first workspace after other scenes must match its first
+# capture.
+for actual in "$tmp"/*.ppm; do
+  name=$(basename "$actual" .ppm)
+  golden="$goldens/$name.ppm"
+  alias=
+
+  case $name in
+    workspace-0-*) alias=1 golden="$goldens/workspace-0.ppm" ;;
+  esac
+
+  if [ -n "$UPDATE_GOLDENS" ]; then
+    [ -z "$alias" ] || continue
+
+    cp "$actual" "$goldens/$name.ppm"
+    echo "Recorded $name"
+    continue
+  fi
+
+  if [ ! -e "$golden" ]; then
+    echo "No golden image for $name; run with UPDATE_GOLDENS=1 to record one"
+    continue
+  fi
+
+  compared=$((compared + 1))
+
+  if ! ./frame-diff -t $tolerance -o "$name-diff.ppm" "$golden" "$actual"
+  then
+    cp "$actual" "$name-actual.ppm"
+    echo "FAIL: $name differs from $golden; see $name-diff.ppm"
+    failed=$((failed + 1))
+  else
+    rm -f "$name-diff.ppm"
+  fi
+done
+
+if [ -n "$UPDATE_GOLDENS" ]; then exit 0; fi
+if [ $failed != 0 ]; then exit 1; fi
+if [ $compared = 0 ]; then exit 77; fi
+
+exit 0
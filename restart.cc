@@ -0,0 +1,343 @@
+#include "cantera-wm.h"
+
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+#include "ewmh.h"
+#include "launcher.h"
+#include "log.h"
+#include "settings.h"
+
+// The state is plain text, one record per line, written and read by the
+// same version of this file:
+//
+//   cantera-wm-state 1
+//   active-screen SCREEN
+//   screen SCREEN ACTIVE-WORKSPACE COUNT WORKSPACE...
+//   window XID SCREEN WORKSPACE TYPE OVERRIDE-REDIRECT MAPPED ACCEPTS-INPUT
+//          PID TRANSIENT-FOR VISUAL X Y WIDTH HEIGHT NAME
+//   focus SCREEN WORKSPACE COUNT XID...
+//   child PID SECONDS NANOSECONDS SCREEN WORKSPACE COUNT XID... COMMAND
+//
+// Window records appear bottom to top.  SCREEN is -1 for unpositioned
+// windows, and WORKSPACE -1 for ancillary ones.  Focus records list windows
+// most recently focused first.  Strings are written as their length, a
+// space and their bytes.
+
+namespace cantera_wm {
+
+namespace {
+
+const char kStateMagic[] = "cantera-wm-state";
+const int kStateVersion = 1;
+
+void WriteString(FILE* output, const std::string& string) {
+  fprintf(output, " %zu ", string.size());
+  fwrite(string.data(), 1, string.size(), output);
+}
+
+bool ReadString(FILE* input, std::string* string) {
+  size_t length;
+
+  if (1 != fscanf(input, "%zu", &length) || fgetc(input) != ' ') return false;
+
+  string->resize(length);
+
+  return length == fread(&(*string)[0], 1, length, input);
+}
+
+void WriteWindow(FILE* output, const Window* w, int screen, int workspace) {
+  VisualID visual = w->x_visual ? XVisualIDFromVisual(w->x_visual) : 0;
+
+  fprintf(output, "window %lu %d %d %d %d %d %d %d %lu %lu %d %d %u %u",
+          w->x_window, screen, workspace, static_cast<int>(w->Type()),
+          w->override_redirect, w->Mapped(), w->AcceptsInput(),
+          static_cast<int>(w->PID()), w->x_transient_for, visual,
+          w->position.x, w->position.y, w->position.width,
+          w->position.height);
+  WriteString(output, w->Name());
+  fputc('\n', output);
+}
+
+Visual* VisualFromID(VisualID id) {
+  XVisualInfo visual_template;
+  int count;
+  Visual* result = nullptr;
+
+  visual_template.visualid = id;
+
+  if (auto info =
+          XGetVisualInfo(x_display, VisualIDMask, &visual_template, &count)) {
+    result = info->visual;
+    XFree(info);
+  }
+
+  return result;
+}
+
+}  // namespace
+
+void Session::SaveState(FILE* output) {
+  fprintf(output, "%s %d\n", kStateMagic, kStateVersion);
+  fprintf(output, "active-screen %u\n", active_screen_);
+
+  for (auto w : unpositioned_windows_) WriteWindow(output, w, -1, -1);
+
+  for (size_t i = 0; i < screens_.size(); ++i) {
+    const auto& screen = screens_[i];
+
+    fprintf(output, "screen %zu %u %zu", i, screen.active_workspace,
+            screen.navigation_stack.size());
+
+    for (auto index : screen.navigation_stack) fprintf(output, " %u", index);
+
+    fputc('\n', output);
+
+    for (auto w : screen.ancillary_windows) WriteWindow(output, w, i, -1);
+
+    for (const auto& entry : screen.workspaces) {
+      std::vector<const Window*> focus_order;
+
+      for (auto w : entry.second) WriteWindow(output, w, i, entry.first);
+
+      for (auto w = entry.second.focus_list; w; w = w->NextInFocusList())
+        focus_order.push_back(w);
+
+      fprintf(output, "focus %zu %u %zu", i, entry.first, focus_order.size());
+
+      for (auto w : focus_order) fprintf(output, " %lu", w->x_window);
+
+      fputc('\n', output);
+    }
+  }
+
+  for (const auto& entry : Children()) {
+    const auto& child = entry.second;
+
+    // Only running children are ours to reap after exec().
+    if (child.exited) continue;
+
+    fprintf(output, "child %d %ld %ld %zu %u %zu", static_cast<int>(child.pid),
+            static_cast<long>(child.launch_time.tv_sec),
+            static_cast<long>(child.launch_time.tv_nsec), child.screen_index,
+            child.workspace_index, child.windows.size());
+
+    for (auto x_window : child.windows) fprintf(output, " %lu", x_window);
+
+    WriteString(output, child.command);
+    fputc('\n', output);
+  }
+}
+
+bool Session::RestoreState(FILE* input) {
+  char keyword[32];
+  int version;
+
+  if (2 != fscanf(input, "%31s %d", keyword, &version) ||
+      strcmp(keyword, kStateMagic) || version != kStateVersion)
+    return false;
+
+  std::unordered_map< ::Window, Window*> windows;
+
+  // Screens that have gone away leave their workspaces to the first screen,
+  // as in UpdateScreens().
+  std::map<std::pair<int, int>, unsigned int> moved_workspaces;
+
+  auto locate = [this, &moved_workspaces](int screen_index, int index,
+                                          Screen** screen) -> unsigned int {
+    if (static_cast<size_t>(screen_index) < screens_.size()) {
+      *screen = &screens_[screen_index];
+      return index;
+    }
+
+    *screen = &screens_[0];
+
+    auto i = moved_workspaces.find(std::make_pair(screen_index, index));
+
+    if (i != moved_workspaces.end()) return i->second;
+
+    int free_workspace =
+        screens_[0].workspaces.FindFree(index, settings.workspace_count);
+    unsigned int result = (free_workspace >= 0) ? free_workspace : index;
+
+    moved_workspaces[std::make_pair(screen_index, index)] = result;
+
+    return result;
+  };
+
+  bool ok = true;
+
+  while (1 == fscanf(input, "%31s", keyword)) {
+    if (!strcmp(keyword, "active-screen")) {
+      unsigned int index;
+
+      if (1 != fscanf(input, "%u", &index)) break;
+
+      if (index < screens_.size()) active_screen_ = index;
+    } else if (!strcmp(keyword, "screen")) {
+      size_t index, count;
+      unsigned int active_workspace;
+
+      if (3 != fscanf(input, "%zu %u %zu", &index, &active_workspace, &count))
+        break;
+
+      std::vector<unsigned int> navigation_stack(count);
+
+      for (auto& entry : navigation_stack) {
+        if (1 != fscanf(input, "%u", &entry)) goto done;
+      }
+
+      if (index >= screens_.size()) continue;
+
+      screens_[index].active_workspace = active_workspace;
+      screens_[index].navigation_stack = std::move(navigation_stack);
+    } else if (!strcmp(keyword, "window")) {
+      unsigned long x_window, transient_for, visual_id;
+      int screen_index, workspace_index, type, override_redirect, mapped,
+          accepts_input, pid;
+      Rectangle position;
+      unsigned int width, height;
+      int x, y;
+      std::string name;
+
+      if (14 != fscanf(input, "%lu %d %d %d %d %d %d %d %lu %lu %d %d %u %u",
+                       &x_window, &screen_index, &workspace_index, &type,
+                       &override_redirect, &mapped, &accepts_input, &pid,
+                       &transient_for, &visual_id, &x, &y, &width, &height) ||
+          fgetc(input) != ' ' || !ReadString(input, &name))
+        break;
+
+      position.x = x;
+      position.y = y;
+      position.width = width;
+      position.height = height;
+
+      auto w = NewWindow(x_window, position, override_redirect);
+
+      w->type = static_cast<Window::WindowType>(type);
+      w->x_transient_for = transient_for;
+      w->SetPID(pid);
+      w->SetName(std::move(name));
+
+      XWMHints hints = {};
+      hints.flags = InputHint;
+      hints.input = accepts_input;
+      w->SetWMHints(hints);
+
+      windows[x_window] = w;
+
+      if (screen_index < 0) {
+        unpositioned_windows_.push_back(w);
+      } else {
+        Screen* screen;
+
+        if (workspace_index < 0) {
+          locate(screen_index, 0, &screen);
+          screen->ancillary_windows.push_back(w);
+          ClientListAdd(x_window);
+
+          // Struts are not saved; there are only ever a few docks.
+          if (w->Type() == Window::window_type_dock) {
+            w->GetStrut();
+            StrutsChanged();
+          }
+        } else {
+          unsigned int index = locate(screen_index, workspace_index, &screen);
+          auto& destination = screen->workspaces.Get(index);
+          destination.push_back(w);
+          w->SetFocusList(&destination.focus_list);
+          ClientListAdd(x_window);
+        }
+      }
+
+      if (mapped) {
+        w->SetMapped(true);
+
+        if (auto visual = VisualFromID(visual_id))
+          w->init_composite(visual);
+        else
+          w->init_composite();
+      }
+    } else if (!strcmp(keyword, "focus")) {
+      int screen_index, workspace_index;
+      size_t count;
+
+      if (3 != fscanf(input, "%d %d %zu", &screen_index, &workspace_index,
+                      &count))
+        break;
+
+      std::vector< ::Window> focus_order(count);
+
+      for (auto& x_window : focus_order) {
+        if (1 != fscanf(input, "%lu", &x_window)) goto done;
+      }
+
+      // Marking from the least recently focused end rebuilds the order.
+      for (auto i = focus_order.rbegin(); i != focus_order.rend(); ++i) {
+        auto w = windows.find(*i);
+
+        if (w != windows.end()) w->second->MarkFocused();
+      }
+    } else if (!strcmp(keyword, "child")) {
+      int pid;
+      long seconds, nanoseconds;
+      size_t screen_index, count;
+      unsigned int workspace_index;
+      std::string command;
+
+      if (6 != fscanf(input, "%d %ld %ld %zu %u %zu", &pid, &seconds,
+                      &nanoseconds, &screen_index, &workspace_index, &count))
+        break;
+
+      std::vector<unsigned long> child_windows(count);
+
+      for (auto& x_window : child_windows) {
+        if (1 != fscanf(input, "%lu", &x_window)) goto done;
+      }
+
+      if (fgetc(input) != ' ' || !ReadString(input, &command)) break;
+
+      timespec launch_time;
+      launch_time.tv_sec = seconds;
+      launch_time.tv_nsec = nanoseconds;
+
+      auto child = RestoreChild(pid, command, launch_time);
+      child->screen_index = screen_index;
+      child->workspace_index = workspace_index;
+      child->windows = std::move(child_windows);
+    } else {
+      LOG(kWarning, "Unknown record '%s' in saved state", keyword);
+      ok = false;
+      break;
+    }
+  }
+
+done:
+  if (!feof(input)) ok = false;
+
+  FitWorkspaces();
+
+  for (auto& screen : screens_) {
+    for (auto& entry : screen.workspaces) {
+      for (auto w : entry.second) {
+        if (entry.first == screen.active_workspace)
+          w->show();
+        else
+          w->hide();
+      }
+    }
+  }
+
+  auto screen = ActiveScreen();
+  screen->UpdateFocus(screen->active_workspace, CurrentTime);
+
+  SetDirty();
+
+  LOG(kInfo, "Restored %zu windows from saved state", windows.size());
+
+  return ok;
+}
+
+}  // namespace cantera_wm
@@ -0,0 +1,244 @@
+#include "cantera-wm.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <err.h>
+#include <X11/extensions/Xcomposite.h>
+
+#include "compositor.h"
+#include "log.h"
+#include "menu.h"
+
+namespace cantera_wm {
+
+namespace {
+
+// Returns a bitmap with the lowest `count` bits set.
+uint64_t LowBits(unsigned int count) {
+  return (count >= 64) ? ~UINT64_C(0) : (UINT64_C(1) << count) - 1;
+}
+
+}  // namespace
+
+const workspace& WorkspaceSet::operator[](unsigned int index) const {
+  static const workspace empty;
+
+  if (!(occupied_ & (UINT64_C(1) << index))) return empty;
+
+  return windows_.find(index)->second;
+}
+
+workspace& WorkspaceSet::Get(unsigned int index) {
+  occupied_ |= UINT64_C(1) << index;
+
+  return windows_[index];
+}
+
+void WorkspaceSet::Prune(unsigned int index) {
+  auto i = windows_.find(index);
+
+  if (i == windows_.end() || !i->second.empty()) return;
+
+  windows_.erase(i);
+  occupied_ &= ~(UINT64_C(1) << index);
+}
+
+void WorkspaceSet::Swap(unsigned int a, unsigned int b) {
+  if (a == b) return;
+
+  // Moving the nodes keeps pointers to the windows lists valid.
+  auto node_a = windows_.extract(a);
+  auto node_b = windows_.extract(b);
+
+  occupied_ &= ~((UINT64_C(1) << a) | (UINT64_C(1) << b));
+
+  if (node_a) {
+    node_a.key() = b;
+    windows_.insert(std::move(node_a));
+    occupied_ |= UINT64_C(1) << b;
+  }
+
+  if (node_b) {
+    node_b.key() = a;
+    windows_.insert(std::move(node_b));
+    occupied_ |= UINT64_C(1) << a;
+  }
+}
+
+int WorkspaceSet::FindFree(unsigned int first, unsigned int count) const {
+  uint64_t free = ~occupied_ & LowBits(count);
+
+  if (uint64_t above = free & ~LowBits(first)) return __builtin_ctzll(above);
+
+  if (free) return __builtin_ctzll(free);
+
+  return -1;
+}
+
+void Screen::AllocateBuffers(bool receive_keys) {
+  if (x_window) return;
+
+  XSetWindowAttributes window_attr;
+  memset(&window_attr, 0, sizeof(window_attr));
+  window_attr.colormap = DefaultColormap(x_display, 0);
+  window_attr.event_mask = ButtonPressMask | ButtonReleaseMask |
+                           PointerMotionMask | ExposureMask;
+  window_attr.override_redirect = True;
+
+  if (receive_keys) window_attr.event_mask |= KeyPressMask | KeyReleaseMask;
+
+  XRenderPictureAttributes pa;
+  memset(&pa, 0, sizeof(pa));
+  pa.subwindow_mode = IncludeInferiors;
+
+  x_window = XCreateWindow(
+      x_display, x_root_window, geometry.x, geometry.y, geometry.width,
+      geometry.height, 0, /* Border */
+      x_visual_info->depth, InputOutput, x_visual,
+      CWOverrideRedirect | CWColormap | CWEventMask, &window_attr);
+
+  current_session.AddInternalXWindow(x_window);
+
+  XCompositeUnredirectWindow(x_display, x_window, CompositeRedirectManual);
+
+  XMapWindow(x_display, x_window);
+
+  if (!(x_picture = XRenderCreatePicture(x_display, x_window,
+                                         x_render_visual_format,
+                                         CPSubwindowMode, &pa)))
+    errx(EXIT_FAILURE, "Failed to create picture for screen window");
+
+  // The pixmap is kept for screen capture, which reads it directly.
+  x_buffer_pixmap = XCreatePixmap(x_display, x_window, geometry.width,
+                                  geometry.height, x_visual_info->depth);
+
+  if (!(x_buffer = XRenderCreatePicture(x_display, x_buffer_pixmap,
+                                        x_render_visual_format, 0, 0)))
+    errx(EXIT_FAILURE, "Failed to create back buffer for screen");
+
+  menu_init_screen(this);
+
+  LOG(kInfo, "Screen %ux%u+%d+%d has window 0x%lx and buffer 0x%lx",
+      geometry.width, geometry.height, geometry.x, geometry.y, x_window,
+      x_buffer);
+}
+
+void Screen::ReleaseBuffers() {
+  for (auto picture : resize_buffers) XRenderFreePicture(x_display, picture);
+  resize_buffers.clear();
+
+  if (x_damage_region) {
+    XFixesDestroyRegion(x_display, x_damage_region);
+    x_damage_region = 0;
+  }
+
+  if (!x_window) return;
+
+  if (ParallelCompositingEnabled()) WaitForCompositeJobs();
+
+  if (transition_picture) {
+    XRenderFreePicture(x_display, transition_picture);
+    transition_picture = 0;
+  }
+
+  XRenderFreePicture(x_display, x_buffer);
+  XRenderFreePicture(x_display, x_picture);
+  XFreePixmap(x_display, x_buffer_pixmap);
+
+  current_session.RemoveInternalXWindow(x_window);
+  XDestroyWindow(x_display, x_window);
+
+  x_window = 0;
+  x_picture = 0;
+  x_buffer = 0;
+  x_buffer_pixmap = 0;
+}
+
+void Screen::PlaceWindow(Window* w) {
+  current_session.UpdateWorkAreas();
+
+  switch (w->Type()) {
+    case Window::window_type_desktop:
+      w->position = geometry;
+      break;
+
+    case Window::window_type_dock:
+      break;
+
+    case Window::window_type_normal:
+      w->position = work_area;
+      break;
+
+    default:
+      LOG(kWarning, "Unhandled type of window: %s",
+          Window::StringFromType(w->Type()));
+    case Window::window_type_dialog:
+      w->position.width = std::min(w->position.width, work_area.width);
+      w->position.height = std::min(w->position.height, work_area.height);
+      w->position.x =
+          work_area.x + work_area.width / 2 - w->position.width / 2;
+      w->position.y =
+          work_area.y + work_area.height / 2 - w->position.height / 2;
+  }
+}
+
+unsigned int Screen::AdoptWindows(workspace& windows, unsigned int fallback,
+                                  unsigned int count) {
+  int free_workspace = workspaces.FindFree(0, count);
+  unsigned int index = (free_workspace >= 0) ? free_workspace : fallback;
+
+  auto& destination = workspaces.Get(index);
+  destination.insert(destination.end(), windows.begin(), windows.end());
+
+  // Relink the focus list from its least recently focused end, so that the
+  // order is kept.
+  std::vector<Window*> focus_order;
+
+  for (auto w = windows.focus_list; w; w = w->NextInFocusList())
+    focus_order.push_back(w);
+
+  for (auto window : windows) window->SetFocusList(&destination.focus_list);
+
+  for (auto w = focus_order.rbegin(); w != focus_order.rend(); ++w)
+    (*w)->MarkFocused();
+
+  windows.clear();
+
+  return index;
+}
+
+bool Screen::FitWorkspaces(unsigned int count) {
+  std::vector<unsigned int> excess;
+  unsigned int old_active_workspace = active_workspace;
+
+  for (const auto& entry : workspaces) {
+    if (entry.first >= count) excess.push_back(entry.first);
+  }
+
+  if (excess.empty() && active_workspace < count) return false;
+
+  for (auto old_index : excess) {
+    unsigned int index =
+        AdoptWindows(workspaces.Get(old_index), count - 1, count);
+
+    workspaces.Prune(old_index);
+
+    if (old_index == active_workspace) active_workspace = index;
+  }
+
+  if (active_workspace >= count) active_workspace = 0;
+
+  for (auto window : workspaces[active_workspace]) window->show();
+
+  navigation_stack.erase(
+      std::remove_if(navigation_stack.begin(), navigation_stack.end(),
+                     [count](unsigned int index) { return index >= count; }),
+      navigation_stack.end());
+
+  return active_workspace != old_active_workspace;
+}
+
+}  // namespace cantera_wm
@@ -2,44 +2,341 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <ctime>
 
 #include <X11/extensions/Xcomposite.h>
 
+#include "capture.h"
+#include "compositor.h"
+#include "event-loop.h"
+#include "ewmh.h"
+#include "log.h"
 #include "menu.h"
+#include "settings.h"
 
 namespace cantera_wm {
 
+namespace {
+
+// Interval of the workspace transition frame clock.
+const unsigned int kFrameIntervalMs = 16;
+
+// If a frame is this late, the event loop is too busy to animate smoothly,
+// and transitions complete immediately instead.
+const unsigned int kFrameBudgetMs = 3 * kFrameIntervalMs;
+
+}  // namespace
+
 void Session::ProcessXCreateWindowEvent(const XCreateWindowEvent& cwe) {
   if (WindowIsInternal(cwe.window)) return;
 
-  cantera_wm::Window* new_window = new cantera_wm::Window;
+  // Windows created while we adopted the existing ones are seen twice.
+  if (find_x_window(cwe.window)) return;
+
+  Rectangle position;
+  position.x = cwe.x;
+  position.y = cwe.y;
+  position.width = cwe.width;
+  position.height = cwe.height;
+
+  auto new_window = NewWindow(cwe.window, position, cwe.override_redirect);
 
-  new_window->x_window = cwe.window;
-  new_window->position.x = cwe.x;
-  new_window->position.y = cwe.y;
-  new_window->position.width = cwe.width;
-  new_window->position.height = cwe.height;
+  new_window->GetWMHints();
+  new_window->GetName();
+
+  unpositioned_windows_.push_back(new_window);
+}
+
+cantera_wm::Window* Session::NewWindow(::Window x_window,
+                                      const Rectangle& position,
+                                      bool override_redirect) {
+  cantera_wm::Window* new_window = new cantera_wm::Window;
 
-  new_window->real_position = new_window->position;
+  new_window->x_window = x_window;
+  new_window->position = position;
+  new_window->real_position = position;
 
-  if (cwe.override_redirect) {
-    XCompositeUnredirectWindow(x_display, cwe.window, CompositeRedirectManual);
+  if (override_redirect) {
+    XCompositeUnredirectWindow(x_display, x_window, CompositeRedirectManual);
     new_window->override_redirect = true;
   }
 
-  XSelectInput(x_display, cwe.window, PropertyChangeMask);
+  XSelectInput(x_display, x_window, PropertyChangeMask | FocusChangeMask);
 
-  new_window->GetWMHints();
-  new_window->GetName();
+  return new_window;
+}
 
-  unpositioned_windows_.push_back(new_window);
+CompositeJob Session::BuildCompositeJob(const Screen& screen) {
+  CompositeJob job;
+  job.x_buffer = screen.x_buffer;
+  job.x_picture = screen.x_picture;
+  job.width = screen.geometry.width;
+  job.height = screen.geometry.height;
+
+  auto add_layer = [&screen, &job](const cantera_wm::Window* window) {
+    CompositeLayer layer;
+    layer.picture = window->x_picture;
+    layer.x = window->real_position.x - screen.geometry.x;
+    layer.y = window->real_position.y - screen.geometry.y;
+    layer.width = window->real_position.width;
+    layer.height = window->real_position.height;
+    layer.opaque = window->Opaque();
+
+    job.layers.push_back(layer);
+  };
+
+  for (auto& window : screen.ancillary_windows) {
+    if (!window->x_picture) {
+      LOG(kDebug, "Ancillary window does not have X picture");
+      continue;
+    }
+
+    add_layer(window);
+  }
+
+  size_t ancillary_layers = job.layers.size();
+
+  for (auto& window : screen.workspaces[screen.active_workspace]) {
+    if (!window->x_picture) {
+      LOG(kDebug, "Window in active workspace does not have picture");
+      continue;
+    }
+
+    if (window->real_position.x >= screen.geometry.x + screen.geometry.width) {
+      LOG(kDebug, "Window is to the right of the screen (%d > %d + %d)",
+          window->real_position.x, screen.geometry.x, screen.geometry.width);
+    } else if (window->real_position.y >=
+               screen.geometry.y + screen.geometry.height) {
+      LOG(kDebug, "Window is above the screen");
+    } else if (window->real_position.x + window->real_position.width <
+               screen.geometry.x) {
+      LOG(kDebug, "Window is to the left of the screen");
+    } else if (window->real_position.y + window->real_position.height <
+               screen.geometry.y) {
+      LOG(kDebug, "Window is below the screen");
+    } else {
+      add_layer(window);
+    }
+  }
+
+  if (screen.transition_picture) {
+    // The duration may have been set to zero by a reload since.
+    double t = 1.0;
+
+    if (settings.workspace_animation_ms)
+      t = std::min(static_cast<double>(Now() - screen.transition_start_ms) /
+                       settings.workspace_animation_ms,
+                   1.0);
+
+    t = t * t * (3.0 - 2.0 * t);
+
+    int offset = static_cast<int>(t * screen.geometry.width);
+
+    if (screen.transition_direction > 0) offset = -offset;
+
+    int incoming_offset =
+        offset + screen.transition_direction * screen.geometry.width;
+
+    // Docks and the desktop stay where they are; only the work area of the
+    // outgoing snapshot and the windows of the incoming workspace slide.
+    for (auto i = ancillary_layers; i < job.layers.size(); ++i)
+      job.layers[i].x += incoming_offset;
+
+    const auto& area = screen.work_area;
+
+    CompositeLayer outgoing;
+    outgoing.picture = screen.transition_picture;
+    outgoing.source_x = area.x - screen.geometry.x;
+    outgoing.source_y = area.y - screen.geometry.y;
+    outgoing.x = outgoing.source_x + offset;
+    outgoing.y = outgoing.source_y;
+    outgoing.width = area.width;
+    outgoing.height = area.height;
+    outgoing.opaque = true;
+
+    job.layers.insert(job.layers.begin() + ancillary_layers, outgoing);
+  }
+
+  job.CullOccluded();
+
+  return job;
+}
+
+void Session::PaintClock(Screen& screen) {
+  XRectangle area;
+
+  menu_clock_area(screen, &area);
+
+  // Only the clock changes, so the rest of the back buffer is still good.
+  XRenderSetPictureClipRectangles(x_display, screen.x_buffer, 0, 0, &area, 1);
+
+  auto job = BuildCompositeJob(screen);
+  job.Draw(x_display);
+
+  menu_draw_clock(screen);
+
+  XFixesSetPictureClipRegion(x_display, screen.x_buffer, 0, 0, None);
+
+  job.Present(x_display, area);
+}
+
+void Session::ShowMenu() {
+  if (showing_menu_) return;
+  showing_menu_ = true;
+  SetDirty();
+
+  ScheduleClockUpdate();
+}
+
+void Session::HideMenu() {
+  if (!showing_menu_) return;
+  showing_menu_ = false;
+  SetDirty();
+
+  CancelTimer(clock_timer_);
+  clock_timer_ = 0;
+}
+
+void Session::ScheduleClockUpdate() {
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  // Tick just after the second changes.
+  clock_timer_ = AddTimer(1000 - now.tv_nsec / 1000000, [this] {
+    clock_timer_ = 0;
+    clock_dirty_ = true;
+
+    if (showing_menu_) ScheduleClockUpdate();
+  });
+}
+
+void Session::StartTransition(Screen* screen, int direction) {
+  if (!settings.workspace_animation_ms || !screen->x_buffer || showing_menu_)
+    return;
+
+  EndTransition(screen);
+
+  // Whatever the screen shows now slides out.
+  Pixmap pixmap =
+      XCreatePixmap(x_display, screen->x_window, screen->geometry.width,
+                    screen->geometry.height, x_visual_info->depth);
+
+  screen->transition_picture = XRenderCreatePicture(
+      x_display, pixmap, x_render_visual_format, 0, nullptr);
+
+  XFreePixmap(x_display, pixmap);
+
+  XRenderComposite(x_display, PictOpSrc, screen->x_buffer, None,
+                   screen->transition_picture, 0, 0, 0, 0, 0, 0,
+                   screen->geometry.width, screen->geometry.height);
+
+  screen->transition_direction = (direction > 0) ? 1 : -1;
+  screen->transition_start_ms = Now();
+
+  SetDirty(screen);
+
+  if (!animation_timer_) ScheduleAnimationFrame();
+}
+
+void Session::EndTransition(Screen* screen) {
+  if (!screen->transition_picture) return;
+
+  if (ParallelCompositingEnabled()) WaitForCompositeJobs();
+
+  XRenderFreePicture(x_display, screen->transition_picture);
+  screen->transition_picture = 0;
+
+  SetDirty(screen);
+}
+
+void Session::FinishTransitions() {
+  for (auto& screen : screens_) EndTransition(&screen);
+
+  CancelTimer(animation_timer_);
+  animation_timer_ = 0;
+}
+
+void Session::ScheduleAnimationFrame() {
+  unsigned long long deadline = Now() + kFrameIntervalMs;
+
+  animation_timer_ = AddTimer(
+      kFrameIntervalMs, [this, deadline] { AnimationFrame(deadline); });
+}
+
+void Session::AnimationFrame(unsigned long long deadline_ms) {
+  unsigned long long now = Now();
+
+  animation_timer_ = 0;
+
+  // Positions follow the clock, so a late frame just skips ahead; a very
+  // late one means we are too busy to animate at all.
+  if (now > deadline_ms + kFrameBudgetMs) {
+    LOG(kInfo, "Animation frame %llu ms late; completing transitions",
+        now - deadline_ms);
+    FinishTransitions();
+    return;
+  }
+
+  bool animating = false;
+
+  for (auto& screen : screens_) {
+    if (!screen.transition_picture) continue;
+
+    if (now - screen.transition_start_ms >= settings.workspace_animation_ms) {
+      EndTransition(&screen);
+    } else {
+      SetDirty(&screen);
+      animating = true;
+    }
+  }
+
+  if (animating) ScheduleAnimationFrame();
 }
 
 void Session::Paint() {
+  bool synced = false;
+
+  // Screens to capture after painting, with their damage.
+  std::vector<std::pair<size_t, std::vector<XRectangle>>> captures;
+
+  // Pictures may be drawn to directly below, so the previous frame must be
+  // out of the compositing threads first.
+  if (ParallelCompositingEnabled()) WaitForCompositeJobs();
+
   for (cantera_wm::Screen& screen : current_session.screens_) {
-    XRenderColor black;
     bool draw_menu;
 
+    if (!screen.x_window) {
+      /* Only the first screen window gets key events */
+      screen.AllocateBuffers(&screen == &screens_.front());
+    } else if (!repaint_all_ && !screen.dirty && !screen.x_damage_region) {
+      if (clock_dirty_ && showing_menu_) PaintClock(screen);
+
+      continue;
+    }
+
+    if (CaptureEnabled()) {
+      captures.emplace_back(&screen - &screens_.front(),
+                            std::vector<XRectangle>());
+
+      if (!repaint_all_ && !screen.dirty && screen.x_damage_region) {
+        int count;
+        XRectangle* rects =
+            XFixesFetchRegion(x_display, screen.x_damage_region, &count);
+
+        for (int i = 0; i < count; ++i) {
+          rects[i].x -= screen.geometry.x;
+          rects[i].y -= screen.geometry.y;
+        }
+
+        captures.back().second.assign(rects, rects + count);
+
+        XFree(rects);
+      }
+    }
+
+    screen.dirty = false;
+
     draw_menu =
         showing_menu_ || screen.workspaces[screen.active_workspace].empty();
 
@@ -56,72 +353,161 @@ void Session::Paint() {
 #endif
     }
 
-    black.red = 0x0000;
-    black.green = 0x0000;
-    black.blue = 0x0000;
-    black.alpha = 0xffff;
+    CompositeJob job = BuildCompositeJob(screen);
 
-    XRenderFillRectangle(x_display, PictOpSrc, screen.x_buffer, &black, 0, 0,
-                         screen.geometry.width, screen.geometry.height);
-
-    for (auto& window : screen.ancillary_windows) {
-      if (!window->x_picture) {
-        fprintf(stderr, "Ancillary window does not have X picture\n");
-        continue;
+    if (!draw_menu && ParallelCompositingEnabled()) {
+      // The compositing threads use resources created on this connection.
+      if (!synced) {
+        XSync(x_display, False);
+        synced = true;
       }
 
-      XRenderComposite(
-          x_display, PictOpSrc, window->x_picture, None, screen.x_buffer, 0, 0,
-          0, 0, window->real_position.x - screen.geometry.x,
-          window->real_position.y - screen.geometry.y,
-          window->real_position.width, window->real_position.height);
-    }
+      SubmitCompositeJob(&screen - &screens_.front(), std::move(job));
+    } else {
+      job.Draw(x_display);
 
-    for (auto& window : screen.workspaces[screen.active_workspace]) {
-      if (!window->x_picture) {
-        fprintf(stderr, "Window in active workspace does not have picture\n");
-        continue;
-      }
+      if (draw_menu) menu_draw(screen);
 
-      if (window->real_position.x >=
-          screen.geometry.x + screen.geometry.width) {
-        fprintf(stderr, "Window is to the right of the screen (%d > %d + %d)\n",
-                window->real_position.x, screen.geometry.x,
-                screen.geometry.width);
-      } else if (window->real_position.y >=
-                 screen.geometry.y + screen.geometry.height) {
-        fprintf(stderr, "Window is above the screen\n");
-      } else if (window->real_position.x + window->real_position.width <
-                 screen.geometry.x) {
-        fprintf(stderr, "Window is to the left of the screen\n");
-      } else if (window->real_position.y + window->real_position.height <
-                 screen.geometry.y) {
-        fprintf(stderr, "Window is below the screen\n");
-      } else {
-        XRenderComposite(
-            x_display, PictOpSrc, window->x_picture, None, screen.x_buffer, 0,
-            0, 0, 0, window->real_position.x - screen.geometry.x,
-            window->real_position.y - screen.geometry.y,
-            window->real_position.width, window->real_position.height);
-      }
+      job.Present(x_display);
     }
 
-    if (draw_menu) menu_draw(screen);
-
-    XRenderComposite(x_display, PictOpSrc, screen.x_buffer, None,
-                     screen.x_picture, 0, 0, 0, 0, 0, 0, screen.geometry.width,
-                     screen.geometry.height);
-
     if (screen.x_damage_region) {
       XFixesDestroyRegion(x_display, screen.x_damage_region);
       screen.x_damage_region = 0;
     }
   }
 
+  if (!captures.empty()) {
+    if (ParallelCompositingEnabled()) WaitForCompositeJobs();
+
+    for (const auto& capture : captures)
+      CaptureScreen(capture.first, screens_[capture.first], capture.second);
+  }
+
+  FinishCaptureFrame();
+
   current_session.repaint_all_ = false;
+  current_session.clock_dirty_ = false;
+  current_session.repaint_screens_ = false;
   current_session.repaint_some_ = false;
 }
 
+bool Session::UpdateScreens(const std::vector<Rectangle>& geometries) {
+  if (geometries.size() == screens_.size() &&
+      std::equal(geometries.begin(), geometries.end(), screens_.begin(),
+                 [](const auto& geometry, const auto& screen) {
+                   return geometry == screen.geometry;
+                 }))
+    return false;
+
+  std::vector<cantera_wm::Screen> old_screens;
+  old_screens.swap(screens_);
+
+  std::vector<bool> reused(old_screens.size(), false);
+  std::vector<bool> assigned(geometries.size(), false);
+
+  screens_.resize(geometries.size());
+
+  // Screens whose geometry is unchanged are kept as they are.
+  for (size_t i = 0; i < geometries.size(); ++i) {
+    for (size_t j = 0; j < old_screens.size(); ++j) {
+      if (reused[j] || !(old_screens[j].geometry == geometries[i])) continue;
+
+      screens_[i] = std::move(old_screens[j]);
+      reused[j] = true;
+      assigned[i] = true;
+
+      break;
+    }
+  }
+
+  // Remaining outputs take over the workspaces of remaining old screens, but
+  // not their buffers, which have the wrong size.
+  for (size_t i = 0, j = 0; i < geometries.size(); ++i) {
+    if (assigned[i]) continue;
+
+    while (j < old_screens.size() && reused[j]) ++j;
+
+    if (j < old_screens.size()) {
+      old_screens[j].ReleaseBuffers();
+      screens_[i] = std::move(old_screens[j]);
+      reused[j] = true;
+    }
+
+    screens_[i].geometry = geometries[i];
+  }
+
+  // Windows on removed screens move to the first screen, into free
+  // workspaces where possible.
+  auto& target = screens_.front();
+
+  for (size_t j = 0; j < old_screens.size(); ++j) {
+    if (reused[j]) continue;
+
+    auto& removed = old_screens[j];
+
+    removed.ReleaseBuffers();
+
+    target.ancillary_windows.insert(target.ancillary_windows.end(),
+                                    removed.ancillary_windows.begin(),
+                                    removed.ancillary_windows.end());
+
+    for (auto& entry : removed.workspaces)
+      target.AdoptWindows(entry.second, entry.first, settings.workspace_count);
+  }
+
+  desktop_geometry_ = screens_.front().geometry;
+
+  for (const auto& screen : screens_)
+    desktop_geometry_.union_rect(screen.geometry);
+
+  if (active_screen_ >= screens_.size()) active_screen_ = 0;
+
+  // The loop below refits every window anyway.
+  ComputeWorkAreas(nullptr);
+
+  // Fit windows to their possibly new screens.
+  for (auto& screen : screens_) {
+    for (auto window : screen.ancillary_windows) screen.PlaceWindow(window);
+
+    for (const auto& entry : screen.workspaces) {
+      for (auto window : entry.second) {
+        screen.PlaceWindow(window);
+
+        if (entry.first == screen.active_workspace)
+          window->show();
+        else
+          window->hide();
+      }
+    }
+  }
+
+  LOG(kInfo, "Now using %zu screen(s)", screens_.size());
+
+  repaint_all_ = true;
+
+  return true;
+}
+
+void Session::FitWorkspaces() {
+  bool focus_changed = false;
+
+  for (auto& screen : screens_) {
+    if (screen.FitWorkspaces(settings.workspace_count)) {
+      screen.UpdateFocus(screen.active_workspace, CurrentTime);
+      focus_changed = true;
+    }
+  }
+
+  // The active screen keeps the input focus.
+  if (focus_changed) {
+    auto screen = ActiveScreen();
+    screen->UpdateFocus(screen->active_workspace, CurrentTime);
+  }
+
+  repaint_all_ = true;
+}
+
 cantera_wm::Screen* Session::find_screen_for_window(::Window x_window) {
   for (auto& screen : screens_) {
     if (screen.x_window == x_window) return &screen;
@@ -154,10 +540,10 @@ cantera_wm::Window* Session::find_x_window(::Window x_window,
       }
     }
 
-    for (auto& workspace : screen.workspaces) {
-      for (auto& window : workspace) {
+    for (auto& entry : screen.workspaces) {
+      for (auto& window : entry.second) {
         if (window->x_window == x_window) {
-          if (workspace_ret) *workspace_ret = &workspace;
+          if (workspace_ret) *workspace_ret = &entry.second;
 
           if (screen_ret) *screen_ret = &screen;
 
@@ -171,9 +557,9 @@ cantera_wm::Window* Session::find_x_window(::Window x_window,
 }
 
 void Session::remove_x_window(::Window x_window) {
-  fprintf(stderr, "Window %08lx was destroyed\n", x_window);
+  LOG(kDebug, "Window %08lx was destroyed", x_window);
 
-  current_session.repaint_all_ = true;
+  DropQueuedProperties(x_window);
 
   auto predicate = [x_window](cantera_wm::Window* window)
                        -> bool { return window->x_window == x_window; };
@@ -182,7 +568,7 @@ void Session::remove_x_window(::Window x_window) {
                         unpositioned_windows_.end(), predicate);
 
   if (i != unpositioned_windows_.end()) {
-    fprintf(stderr, " -> It was unpositioned\n");
+    LOG(kDebug, " -> It was unpositioned");
     delete *i;
 
     unpositioned_windows_.erase(i);
@@ -197,26 +583,41 @@ void Session::remove_x_window(::Window x_window) {
                           screen.ancillary_windows.end(), predicate);
 
     if (i != screen.ancillary_windows.end()) {
-      fprintf(stderr, " -> It was an ancillary window\n");
+      LOG(kDebug, " -> It was an ancillary window");
+      ClientListRemove(x_window);
+
+      if ((*i)->HasStrut()) StrutsChanged();
+
       delete *i;
 
       screen.ancillary_windows.erase(i);
+      SetDirty(&screen);
 
       return;
     }
 
-    unsigned int workspace_index = 0;
+    for (auto& entry : screen.workspaces) {
+      auto& workspace = entry.second;
+      unsigned int workspace_index = entry.first;
 
-    for (auto& workspace : screen.workspaces) {
       auto i = std::find_if(workspace.begin(), workspace.end(), predicate);
 
       if (i != workspace.end()) {
-        fprintf(stderr, " -> It was in a workspace\n");
+        LOG(kDebug, " -> It was in a workspace");
+        ClientListRemove(x_window);
         delete *i;
 
         workspace.erase(i);
+        SetDirty(&screen);
+
+        // Focus goes back to the most recently focused remaining window,
+        // e.g. the parent of a closed dialog.
+        if (!workspace.empty() && screen.active_workspace == workspace_index)
+          screen.UpdateFocus(workspace_index, CurrentTime);
 
         if (workspace.empty()) {
+          screen.workspaces.Prune(workspace_index);
+
           auto& navstack = screen.navigation_stack;
 
           navstack.erase(
@@ -231,25 +632,138 @@ void Session::remove_x_window(::Window x_window) {
 
         return;
       }
-
-      ++workspace_index;
     }
 
     ++screen_index;
   }
 }
 
+Screen* Session::ScreenAt(const Rectangle& position) {
+  int x = position.x + position.width / 2;
+  int y = position.y + position.height / 2;
+
+  for (auto& screen : screens_) {
+    const auto& geometry = screen.geometry;
+
+    if (x >= geometry.x && x < geometry.x + geometry.width && y >= geometry.y &&
+        y < geometry.y + geometry.height)
+      return &screen;
+  }
+
+  return ActiveScreen();
+}
+
+Rectangle Session::SubtractStruts(const Rectangle& area) const {
+  // Struts are measured from the edges of the root window, and reserve
+  // nothing on screens their start and end values do not reach.
+  const long area_left = area.x, area_right = area.x + area.width;
+  const long area_top = area.y, area_bottom = area.y + area.height;
+  const long root_left = desktop_geometry_.x, root_top = desktop_geometry_.y;
+  const long root_right = desktop_geometry_.x + desktop_geometry_.width;
+  const long root_bottom = desktop_geometry_.y + desktop_geometry_.height;
+  long left = area_left, right = area_right;
+  long top = area_top, bottom = area_bottom;
+
+  auto overlaps = [](unsigned long start, unsigned long end, long min,
+                     long max) {
+    return static_cast<long>(start) < max && static_cast<long>(end) >= min;
+  };
+
+  for (const auto& screen : screens_) {
+    for (auto w : screen.ancillary_windows) {
+      const auto& strut = w->Strut();
+
+      if (strut[0] && overlaps(strut[4], strut[5], area_top, area_bottom))
+        left = std::max(left, root_left + static_cast<long>(strut[0]));
+
+      if (strut[1] && overlaps(strut[6], strut[7], area_top, area_bottom))
+        right = std::min(right, root_right - static_cast<long>(strut[1]));
+
+      if (strut[2] && overlaps(strut[8], strut[9], area_left, area_right))
+        top = std::max(top, root_top + static_cast<long>(strut[2]));
+
+      if (strut[3] && overlaps(strut[10], strut[11], area_left, area_right))
+        bottom = std::min(bottom, root_bottom - static_cast<long>(strut[3]));
+    }
+  }
+
+  // A strut that claims the whole area is ignored, so that windows stay
+  // usable.
+  if (left >= right) {
+    left = area_left;
+    right = area_right;
+  }
+
+  if (top >= bottom) {
+    top = area_top;
+    bottom = area_bottom;
+  }
+
+  Rectangle result;
+  result.x = left;
+  result.y = top;
+  result.width = right - left;
+  result.height = bottom - top;
+
+  return result;
+}
+
+void Session::ComputeWorkAreas(std::vector<Screen*>* changed) {
+  for (auto& screen : screens_) {
+    auto work_area = SubtractStruts(screen.geometry);
+
+    if (work_area == screen.work_area) continue;
+
+    screen.work_area = work_area;
+
+    if (changed) changed->push_back(&screen);
+  }
+
+  work_area_ = SubtractStruts(desktop_geometry_);
+  work_areas_valid_ = true;
+}
+
+void Session::UpdateWorkAreas() {
+  if (work_areas_valid_) return;
+
+  std::vector<Screen*> changed;
+  ComputeWorkAreas(&changed);
+
+  for (auto screen : changed) {
+    LOG(kDebug, "Work area is now %ux%u%+d%+d", screen->work_area.width,
+        screen->work_area.height, screen->work_area.x, screen->work_area.y);
+
+    for (const auto& entry : screen->workspaces) {
+      for (auto window : entry.second) {
+        screen->PlaceWindow(window);
+
+        if (entry.first == screen->active_workspace)
+          window->show();
+        else
+          window->hide();
+      }
+    }
+
+    SetDirty(screen);
+  }
+}
+
 void Session::move_window(cantera_wm::Window* w, cantera_wm::Screen* scr,
                           workspace* ws) {
   /* XXX: Eliminate code duplication from remove_x_window */
 
   auto predicate = [w](cantera_wm::Window* arg) -> bool { return w == arg; };
 
+  WorkspaceSet* source_set = nullptr;
+  unsigned int source_index = 0;
+  bool was_managed = true;
+
   auto i = std::find_if(unpositioned_windows_.begin(),
                         unpositioned_windows_.end(), predicate);
 
   if (i != unpositioned_windows_.end()) {
     unpositioned_windows_.erase(i);
+    was_managed = false;
 
     goto found;
   }
@@ -264,23 +778,40 @@ void Session::move_window(cantera_wm::Window* w, cantera_wm::Screen* scr,
       goto found;
     }
 
-    for (auto& workspace : screen.workspaces) {
+    for (auto& entry : screen.workspaces) {
+      auto& workspace = entry.second;
       auto i = std::find_if(workspace.begin(), workspace.end(), predicate);
 
       if (i != workspace.end()) {
         workspace.erase(i);
 
+        source_set = &screen.workspaces;
+        source_index = entry.first;
+
         goto found;
       }
     }
   }
 
+  was_managed = false;
+
 found:
 
-  if (ws)
+  if (ws) {
     ws->push_back(w);
-  else
+    w->SetFocusList(&ws->focus_list);
+  } else {
     scr->ancillary_windows.push_back(w);
+    w->SetFocusList(nullptr);
+  }
+
+  // Only now, since `ws` may be the workspace the window came from.
+  if (source_set) source_set->Prune(source_index);
+
+  if (was_managed)
+    ClientListRaise(w->x_window);
+  else
+    ClientListAdd(w->x_window);
 }
 
 }  // namespace cantera_wm
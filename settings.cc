@@ -0,0 +1,186 @@
+#include "settings.h"
+
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <strings.h>
+
+#include "cantera-wm.h"
+#include "tree.h"
+
+namespace cantera_wm {
+
+Settings settings;
+
+namespace {
+
+// Describes one configuration key.  A `path` ending in ".*" matches every
+// child of that section, and the child's name is passed as `name`.
+struct KeyDescriptor {
+  const char* path;
+  const char* expected;
+  bool (*parse)(const char* name, const char* value, Settings* settings);
+};
+
+bool ParseValue(const char* value, std::string* result) {
+  *result = value;
+  return true;
+}
+
+bool ParseValue(const char* value, bool* result) {
+  if (!strcmp(value, "0") || !strcasecmp(value, "false") ||
+      !strcasecmp(value, "no")) {
+    *result = false;
+    return true;
+  }
+
+  if (!strcmp(value, "1") || !strcasecmp(value, "true") ||
+      !strcasecmp(value, "yes")) {
+    *result = true;
+    return true;
+  }
+
+  return false;
+}
+
+bool ParseValue(const char* value, unsigned int* result) {
+  char* end;
+
+  if (!isdigit(static_cast<unsigned char>(*value))) return false;
+
+  errno = 0;
+  unsigned long parsed = strtoul(value, &end, 0);
+
+  if (*end || errno || parsed > UINT_MAX) return false;
+
+  *result = parsed;
+
+  return true;
+}
+
+template <typename T, T Settings::*Field>
+bool ParseField(const char*, const char* value, Settings* settings) {
+  return ParseValue(value, &(settings->*Field));
+}
+
+bool ParseHotkey(const char* name, const char* value, Settings* settings) {
+  if (name[0] < 'a' || name[0] > 'z' || name[1]) return false;
+
+  return ParseValue(value, &settings->hotkeys[name[0] - 'a']);
+}
+
+bool ParseWorkspaceCount(const char*, const char* value, Settings* settings) {
+  unsigned int count;
+
+  if (!ParseValue(value, &count) || count < 1 || count > kMaxWorkspaceCount)
+    return false;
+
+  settings->workspace_count = count;
+
+  return true;
+}
+
+bool ParseAnimationDuration(const char*, const char* value,
+                            Settings* settings) {
+  unsigned int duration;
+
+  if (!ParseValue(value, &duration) || duration > 1000) return false;
+
+  settings->workspace_animation_ms = duration;
+
+  return true;
+}
+
+bool ParseLogLevel(const char*, const char* value, Settings* settings) {
+  static const struct {
+    const char* name;
+    LogLevel level;
+  } kLevels[] = {
+      {"debug", LogLevel::kDebug},
+      {"info", LogLevel::kInfo},
+      {"warning", LogLevel::kWarning},
+      {"error", LogLevel::kError},
+  };
+
+  for (const auto& level : kLevels) {
+    if (!strcasecmp(value, level.name)) {
+      settings->log_level = level.level;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+constexpr KeyDescriptor kKeys[] = {
+    {"capture.enable", "a boolean",
+     ParseField<bool, &Settings::capture_screens>},
+    {"compositor.parallel", "a boolean",
+     ParseField<bool, &Settings::parallel_compositing>},
+    {"hotkey.*", "a command, with a key from 'a' to 'z'", ParseHotkey},
+    {"log.level", "one of debug, info, warning and error", ParseLogLevel},
+    {"menu.clock_format", "a strftime(3) format",
+     ParseField<std::string, &Settings::menu_clock_format>},
+    {"workspace.animation", "milliseconds, from 0 to 1000",
+     ParseAnimationDuration},
+    {"workspace.count", "a number from 1 to 64", ParseWorkspaceCount},
+};
+
+struct LoadState {
+  const struct tree* config;
+  Settings* settings;
+  bool ok;
+};
+
+const KeyDescriptor* FindKey(const char* path, const char** name) {
+  for (const auto& key : kKeys) {
+    size_t length = strlen(key.path);
+
+    if (length >= 2 && !strcmp(key.path + length - 2, ".*")) {
+      if (!strncmp(path, key.path, length - 1) && path[length - 1]) {
+        *name = path + length - 1;
+        return &key;
+      }
+    } else if (!strcmp(path, key.path)) {
+      *name = path;
+      return &key;
+    }
+  }
+
+  return nullptr;
+}
+
+void LoadNode(const char* path, const char* value, void* arg) {
+  auto state = reinterpret_cast<LoadState*>(arg);
+  const char* name;
+
+  auto key = FindKey(path, &name);
+
+  if (!key) {
+    LOG(kWarning, "%s: unknown key '%s'", tree_get_name(state->config), path);
+    state->ok = false;
+  } else if (!key->parse(name, value, state->settings)) {
+    LOG(kWarning, "%s: expected %s in '%s', found '%s'",
+        tree_get_name(state->config), key->expected, path, value);
+    state->ok = false;
+  }
+}
+
+}  // namespace
+
+bool LoadSettings(const struct tree* config, Settings* result) {
+  LoadState state;
+  state.config = config;
+  state.settings = result;
+  state.ok = true;
+
+  tree_for_each(config, LoadNode, &state);
+
+  return state.ok;
+}
+
+}  // namespace cantera_wm
@@ -0,0 +1,51 @@
+#ifndef SETTINGS_H_
+#define SETTINGS_H_ 1
+
+#include <string>
+
+#include "log.h"
+
+struct tree;
+
+namespace cantera_wm {
+
+// Configuration values from ~/.cantera/config, converted and validated once
+// per load so that event handlers can read them directly.
+struct Settings {
+  // Commands started by Super+<letter>, indexed by `letter - 'a'`.  Empty
+  // strings mean the letter is unbound.
+  std::string hotkeys[26];
+
+  // Whether each screen is composited by a thread with its own X
+  // connection.  Only read at startup.
+  bool parallel_compositing = false;
+
+  // Number of workspaces per screen, from 1 to kMaxWorkspaceCount.  The
+  // menu shows them in rows of 12.
+  unsigned int workspace_count = 24;
+
+  // Length of the slide between workspaces, in milliseconds.  Zero switches
+  // instantly.
+  unsigned int workspace_animation_ms = 0;
+
+  // Whether painted frames are copied to the shared memory segment described
+  // in capture-format.h.
+  bool capture_screens = false;
+
+  // strftime(3) format of the clock line at the top of the menu.
+  std::string menu_clock_format = "%Y-%m-%d %H:%M:%S  " PACKAGE_STRING;
+
+  // Least severe messages written to stderr.
+  LogLevel log_level = LogLevel::kInfo;
+};
+
+extern Settings settings;
+
+// Converts every node of `config` into `result`.  Unknown keys and malformed
+// values are reported on stderr and leave the corresponding default in
+// place.  Returns false if any problem was reported.
+bool LoadSettings(const struct tree* config, Settings* result);
+
+}  // namespace cantera_wm
+
+#endif  // !SETTINGS_H_
@@ -41,8 +41,11 @@ struct tree* tree_create(const char* name) {
 }
 
 void tree_destroy(struct tree* t) {
-  /* XXX: bugfix this arena_free(&t->arena); */
-  memset(t, 0, sizeof(*t));
+  /* The tree itself lives in its arena, so free a copy of the arena.  */
+  struct arena_info arena = t->arena;
+
+  free(t->nodes);
+  arena_free(&arena);
 }
 
 void tree_create_node(struct tree* t, const char* path, const char* value) {
@@ -194,6 +197,18 @@ const char* tree_get_string_default(const struct tree* t, const char* path,
   return def;
 }
 
+const char* tree_get_name(const struct tree* t) { return t->name; }
+
+void tree_for_each(const struct tree* t,
+                   void (*callback)(const char* path, const char* value,
+                                    void* arg),
+                   void* arg) {
+  size_t i;
+
+  for (i = 0; i < t->node_count; ++i)
+    callback(t->nodes[i].path, t->nodes[i].value, arg);
+}
+
 static int is_symbol_char(int ch) {
   return isalnum(ch) || ch == '-' || ch == '_' || ch == '!';
 }
@@ -29,6 +29,13 @@ const char* tree_get_string_default(const struct tree* t, const char* path,
 
 size_t tree_get_strings(const struct tree* t, const char* path, char*** result);
 
+const char* tree_get_name(const struct tree* t);
+
+void tree_for_each(const struct tree* t,
+                   void (*callback)(const char* path, const char* value,
+                                    void* arg),
+                   void* arg);
+
 struct tree* tree_load_cfg(const char* path);
 
 #ifdef __cplusplus
@@ -1,5 +1,6 @@
 #include "cantera-wm.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
@@ -11,6 +12,9 @@
 #include <X11/extensions/Xfixes.h>
 #include <X11/Xatom.h>
 
+#include "compositor.h"
+#include "ewmh.h"
+#include "log.h"
 #include "xa.h"
 
 namespace {
@@ -47,34 +51,170 @@ const char* Window::StringFromType(WindowType type) {
 
 Window::Window() { type = window_type_unknown; }
 
-Window::~Window() {}
+Window::~Window() {
+  // A compositing thread may still be drawing our picture.  Its XID must not
+  // be reused until that job is done.
+  if (x_picture && ParallelCompositingEnabled()) WaitForCompositeJobs();
+
+  UnlinkFocus();
+}
+
+void Window::SetFocusList(Window** list) {
+  UnlinkFocus();
+
+  focus_list_ = list;
+
+  UpdateFocusLink();
+}
+
+void Window::MarkFocused() {
+  if (!in_focus_list_ || *focus_list_ == this) return;
+
+  UnlinkFocus();
+  LinkFocus();
+}
+
+void Window::SetMapped(bool mapped) {
+  mapped_ = mapped;
+
+  UpdateFocusLink();
+}
+
+void Window::LinkFocus() {
+  focus_prev_ = nullptr;
+  focus_next_ = *focus_list_;
+
+  if (focus_next_) focus_next_->focus_prev_ = this;
+
+  *focus_list_ = this;
+  in_focus_list_ = true;
+}
+
+void Window::UnlinkFocus() {
+  if (!in_focus_list_) return;
+
+  if (focus_prev_)
+    focus_prev_->focus_next_ = focus_next_;
+  else
+    *focus_list_ = focus_next_;
+
+  if (focus_next_) focus_next_->focus_prev_ = focus_prev_;
+
+  focus_prev_ = focus_next_ = nullptr;
+  in_focus_list_ = false;
+}
+
+void Window::UpdateFocusLink() {
+  bool focusable = focus_list_ && mapped_ && accepts_input_;
+
+  if (focusable && !in_focus_list_)
+    LinkFocus();
+  else if (!focusable)
+    UnlinkFocus();
+}
 
 void Window::GetName() {
+  XTextProperty text_prop;
+
+  if (!XGetWMName(x_display, x_window, &text_prop)) {
+    name_.clear();
+    return;
+  }
+
+  SetName(text_prop);
+
+  XFree(text_prop.value);
+}
+
+void Window::SetName(const XTextProperty& text_prop) {
   name_.clear();
 
-  XTextProperty text_prop;
-  auto status = XGetWMName(x_display, x_window, &text_prop);
-  if (!status || !text_prop.value || text_prop.nitems < 1) return;
+  if (!text_prop.value || text_prop.nitems < 1) return;
 
   char** list;
   int num;
-  status = Xutf8TextPropertyToTextList(x_display, &text_prop, &list, &num);
-  if (status < 0 || num < 1 || !*list) return;
+  auto status = Xutf8TextPropertyToTextList(x_display, &text_prop, &list, &num);
+  if (status < 0) return;
 
-  name_ = list[0];
+  if (num >= 1 && *list) name_ = list[0];
 
-  XFree(text_prop.value);
   XFreeStringList(list);
 }
 
+void Window::GetPID() {
+  Atom type;
+  int format;
+  unsigned long nitems;
+  unsigned long bytes_after;
+  unsigned char* prop = nullptr;
+
+  pid_ = 0;
+
+  if (Success != XGetWindowProperty(x_display, x_window, xa::net_wm_pid, 0, 1,
+                                    False, XA_CARDINAL, &type, &format,
+                                    &nitems, &bytes_after, &prop))
+    return;
+
+  if (prop && type == XA_CARDINAL && format == 32 && nitems == 1)
+    pid_ = *reinterpret_cast<unsigned long*>(prop);
+
+  XFree(prop);
+}
+
+void Window::GetStrut() {
+  static Atom* const kAtoms[] = {&xa::net_wm_strut_partial, &xa::net_wm_strut};
+
+  for (auto atom : kAtoms) {
+    Atom type;
+    int format;
+    unsigned long nitems;
+    unsigned long bytes_after;
+    unsigned char* prop = nullptr;
+
+    if (Success != XGetWindowProperty(x_display, x_window, *atom, 0, 12, False,
+                                      XA_CARDINAL, &type, &format, &nitems,
+                                      &bytes_after, &prop))
+      continue;
+
+    bool found = prop && type == XA_CARDINAL && format == 32 && nitems;
+
+    if (found) SetStrut(reinterpret_cast<unsigned long*>(prop), nitems);
+
+    XFree(prop);
+
+    if (found) return;
+  }
+
+  SetStrut(nullptr, 0);
+}
+
+void Window::SetStrut(const unsigned long* values, size_t count) {
+  strut_.fill(0);
+
+  if (count == 12) {
+    std::copy(values, values + 12, strut_.begin());
+  } else if (count == 4) {
+    // A full strut spans the whole edge.
+    std::copy(values, values + 4, strut_.begin());
+
+    for (size_t i = 5; i < 12; i += 2) strut_[i] = 0xffff;
+  }
+}
+
 void Window::GetWMHints() {
   if (auto wm_hints = XGetWMHints(x_display, x_window)) {
-    if (wm_hints->flags & InputHint) accepts_input_ = wm_hints->input;
+    SetWMHints(*wm_hints);
 
     XFree(wm_hints);
   }
 }
 
+void Window::SetWMHints(const XWMHints& wm_hints) {
+  if (wm_hints.flags & InputHint) accepts_input_ = wm_hints.input;
+
+  UpdateFocusLink();
+}
+
 void Window::GetHints() {
   if (type != window_type_unknown) return;
 
@@ -87,38 +227,48 @@ void Window::GetHints() {
   unsigned long bytes_after;
   unsigned long* prop;
 
+  Atom window_type = None;
+  ::Window transient_for = 0;
+
   /* XXX: This code has not been verified.  Also, we should use atom_type for
    * something  */
-  if (Success !=
-      XGetWindowProperty(x_display, x_window, xa::net_wm_window_type, 0, 1024,
-                         False, XA_ATOM, &atom_type, &format, &nitems,
-                         &bytes_after, (unsigned char**)&prop))
-    type = window_type_normal;
-  else if (!prop)
-    type = window_type_normal;
-  else if (*prop == xa::net_wm_window_type_desktop)
+  if (Success ==
+          XGetWindowProperty(x_display, x_window, xa::net_wm_window_type, 0,
+                             1024, False, XA_ATOM, &atom_type, &format,
+                             &nitems, &bytes_after, (unsigned char**)&prop) &&
+      prop) {
+    if (nitems) window_type = *prop;
+
+    XFree(prop);
+  }
+
+  XGetTransientForHint(x_display, x_window, &transient_for);
+
+  XSync(x_display, False);
+  XSetErrorHandler(old_error_handler);
+
+  SetType(window_type, transient_for);
+}
+
+void Window::SetType(Atom window_type, ::Window transient_for) {
+  if (window_type == xa::net_wm_window_type_desktop)
     type = window_type_desktop;
-  else if (*prop == xa::net_wm_window_type_dock)
+  else if (window_type == xa::net_wm_window_type_dock)
     type = window_type_dock;
-  else if (*prop == xa::net_wm_window_type_toolbar)
+  else if (window_type == xa::net_wm_window_type_toolbar)
     type = window_type_toolbar;
-  else if (*prop == xa::net_wm_window_type_menu)
+  else if (window_type == xa::net_wm_window_type_menu)
     type = window_type_menu;
-  else if (*prop == xa::net_wm_window_type_utility)
+  else if (window_type == xa::net_wm_window_type_utility)
     type = window_type_utility;
-  else if (*prop == xa::net_wm_window_type_splash)
+  else if (window_type == xa::net_wm_window_type_splash)
     type = window_type_splash;
-  else if (*prop == xa::net_wm_window_type_dialog)
+  else if (window_type == xa::net_wm_window_type_dialog)
     type = window_type_dialog;
-  else /* if (*prop == xa::net_wm_window_type_normal) */
+  else /* if (window_type == xa::net_wm_window_type_normal) */
     type = window_type_normal;
 
-  XFree(prop);
-
-  XGetTransientForHint(x_display, x_window, &x_transient_for);
-
-  XSync(x_display, False);
-  XSetErrorHandler(old_error_handler);
+  x_transient_for = transient_for;
 
   if (x_transient_for && type == window_type_normal) type = window_type_dialog;
 }
@@ -132,7 +282,26 @@ void Window::ReadProperties() {
 
 void Window::constrain_size() {}
 
+void Window::SetWMState(unsigned long state) {
+  QueueProperty(x_window, xa::wm_state, xa::wm_state,
+                {static_cast<long>(state), None});
+}
+
 void Window::init_composite() {
+  Visual* visual = nullptr;
+
+  if (!x_picture && !override_redirect) {
+    XWindowAttributes attr;
+
+    XGetWindowAttributes(x_display, x_window, &attr);
+
+    visual = attr.visual;
+  }
+
+  init_composite(visual);
+}
+
+void Window::init_composite(Visual* visual) {
   if (x_picture) {
     assert(x_damage);
 
@@ -140,20 +309,18 @@ void Window::init_composite() {
   }
 
   if (!override_redirect) {
-    XWindowAttributes attr;
-    XRenderPictFormat* format;
     XRenderPictureAttributes picture_attributes;
 
-    XGetWindowAttributes(x_display, x_window, &attr);
-
-    format = XRenderFindVisualFormat(x_display, attr.visual);
+    x_visual = visual;
+    x_format = XRenderFindVisualFormat(x_display, visual);
 
-    if (!format) errx(EXIT_FAILURE, "Unable to find visual format for window");
+    if (!x_format)
+      errx(EXIT_FAILURE, "Unable to find visual format for window");
 
     memset(&picture_attributes, 0, sizeof(picture_attributes));
     picture_attributes.subwindow_mode = IncludeInferiors;
 
-    x_picture = XRenderCreatePicture(x_display, x_window, format,
+    x_picture = XRenderCreatePicture(x_display, x_window, x_format,
                                      CPSubwindowMode, &picture_attributes);
 
     XRenderColor black;
@@ -168,22 +335,62 @@ void Window::init_composite() {
 
   x_damage = XDamageCreate(x_display, x_window, XDamageReportNonEmpty);
 
-  fprintf(stderr, "Window %08lx has picture %08lx and damage %08lx\n", x_window,
-          x_picture, x_damage);
+  LOG(kDebug, "Window %08lx has %s picture %08lx and damage %08lx", x_window,
+      Opaque() ? "opaque" : "translucent", x_picture, x_damage);
+}
+
+Picture Window::ThumbnailPicture(const XTransform& transform) {
+  if (x_thumbnail_picture_ &&
+      !memcmp(&thumbnail_transform_, &transform, sizeof(transform)))
+    return x_thumbnail_picture_;
+
+  if (!x_picture) return 0;
+
+  if (!x_thumbnail_picture_) {
+    XRenderPictureAttributes picture_attributes;
+
+    memset(&picture_attributes, 0, sizeof(picture_attributes));
+    picture_attributes.subwindow_mode = IncludeInferiors;
+
+    x_thumbnail_picture_ = XRenderCreatePicture(
+        x_display, x_window, x_format, CPSubwindowMode, &picture_attributes);
+
+    XRenderSetPictureFilter(x_display, x_thumbnail_picture_, FilterBilinear, 0,
+                            0);
+  }
+
+  thumbnail_transform_ = transform;
+
+  XRenderSetPictureTransform(x_display, x_thumbnail_picture_,
+                             &thumbnail_transform_);
+
+  return x_thumbnail_picture_;
 }
 
 void Window::reset_composite() {
   /* XXX: It seems these are always already destroyed? */
 
+  // Jobs submitted to the compositing threads refer to pictures by XID.
+  if ((x_picture || x_thumbnail_picture_) && ParallelCompositingEnabled())
+    WaitForCompositeJobs();
+
   if (x_damage) {
     XDamageDestroy(x_display, x_damage);
     x_damage = 0;
   }
 
+  if (x_thumbnail_picture_) {
+    XRenderFreePicture(x_display, x_thumbnail_picture_);
+    x_thumbnail_picture_ = 0;
+  }
+
   if (x_picture) {
     XRenderFreePicture(x_display, x_picture);
     x_picture = 0;
   }
+
+  x_visual = nullptr;
+  x_format = nullptr;
 }
 
 void Window::show() {
@@ -9,7 +9,19 @@
 
 namespace xa {
 
+Atom cantera_wm_capture;
+
 Atom net_active_window;
+Atom net_client_list;
+Atom net_client_list_stacking;
+Atom net_current_desktop;
+Atom net_number_of_desktops;
+Atom net_supported;
+Atom net_workarea;
+
+Atom net_wm_pid;
+Atom net_wm_strut;
+Atom net_wm_strut_partial;
 
 Atom net_wm_window_type;
 
@@ -7,7 +7,19 @@
 
 namespace xa {
 
+extern Atom cantera_wm_capture;
+
 extern Atom net_active_window;
+extern Atom net_client_list;
+extern Atom net_client_list_stacking;
+extern Atom net_current_desktop;
+extern Atom net_number_of_desktops;
+extern Atom net_supported;
+extern Atom net_workarea;
+
+extern Atom net_wm_pid;
+extern Atom net_wm_strut;
+extern Atom net_wm_strut_partial;
 
 extern Atom net_wm_window_type;
 